@@ -32,6 +32,10 @@ struct Bar
    float getClose() const;
    // output bar
    void print() const;
+   // get price as an integer number of 1/scale units, rounded to nearest, throw std::out_of_range if it does not fit in 32 bits
+   static std::int32_t toFixed(float price, int scale);
+   // get price from an integer number of 1/scale units
+   static float fromFixed(std::int32_t price, int scale);
 };
 
 /*-------------------------------------------------------------------------------------------------*/
@@ -90,6 +94,50 @@ void Bar::print() const
 
 /*-------------------------------------------------------------------------------------------------*/
 
+// get price as an integer number of 1/scale units, rounded to nearest, throw std::out_of_range if it does not fit in 32 bits
+// (the scale of the instrument is then too large, see PRICE_SCALES in QuotesDB.hpp)
+// NB: the price parsed is only known as a float, the quoted price is recovered exactly while price * scale is below 2^24
+// (about 7 significant digits), beyond that the result may be off by the float rounding
+std::int32_t Bar::toFixed(float price, int scale)
+{
+   double x = static_cast<double>(price) * scale;
+   x = x < 0 ? x - .5 : x + .5;
+
+   // NB: NaN fails both comparisons
+   if (!(x > std::numeric_limits<std::int32_t>::min() - 1. && x < std::numeric_limits<std::int32_t>::max() + 1.)) {
+      throw std::out_of_range("Bar: price " + std::to_string(price) + " does not fit in 32 bits with scale " + std::to_string(scale));
+   }
+
+   return static_cast<std::int32_t>(x);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get price from an integer number of 1/scale units
+float Bar::fromFixed(std::int32_t price, int scale)
+{
+   return static_cast<double>(price) / scale;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get number of price units per unit of quote currency for an instrument (or a table named after it), 
+// as defined in PRICE_SCALES, prices being stored otherwise as integer numbers of pipettes: 3 decimals 
+// for JPY pairs, 5 decimals for other currency pairs
+int price_scale(const std::string& instrument)
+{
+   for (const auto& elem : PRICE_SCALES) {
+      const std::string& name = elem.first;
+      if (instrument.compare(0, name.size(), name) == 0 && (instrument.size() == name.size() || instrument[name.size()] == '_')) {
+         return elem.second;
+      }
+   }
+
+   return instrument.find("JPY") != std::string::npos ? 1000 : 100000;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
 // cout overload for outputting a Bar
 std::ostream& operator<<(std::ostream& out, Bar& x)
 {
@@ -0,0 +1,278 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef BARCACHE_HPP
+#define BARCACHE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// in-memory cache of date ranges read from tables, each table keeps disjoint segments of dates 
+// known to be complete, segments are evicted in least recently used order beyond a memory cap
+// NB: a segment ending at OPEN covers all dates up to the most recent Bar at the time it was 
+// last refreshed, newer Bars are fetched again on the next read reaching the end of the table,
+// and a read ending before the current time is only known complete up to the last Bar it returned
+
+class BarCache
+{
+public:
+   // end date of segments reaching the end of the table
+   static const unsigned OPEN = std::numeric_limits<unsigned>::max();
+
+   // parameter constructor
+   explicit BarCache(std::size_t max_bytes);
+   // get Bars from table with dates in [start_t,end_t], missing dates being read with fetch(start_t,end_t)
+   // NB: fetch must throw when a read fails, dates it returns being taken as complete
+   template <class Fetch>
+   std::vector<Bar> get(const std::string& tab_name, unsigned start_t, unsigned end_t, Fetch fetch);
+   // get last n Bars from table (most recent first), reading them with fetch_last(n) if not cached
+   template <class Fetch, class FetchLast>
+   std::vector<Bar> get_last(const std::string& tab_name, unsigned n, Fetch fetch, FetchLast fetch_last);
+   // remove segments of table whose Bars may change after writing dates [start_t,end_t]
+   void invalidate(const std::string& tab_name, unsigned start_t = 0, unsigned end_t = OPEN);
+   // get memory used by cached Bars in bytes
+   std::size_t memory() const;
+
+private:
+   typedef std::pair<std::string,unsigned> Key;
+
+   // range of dates [first,last] known to be complete
+   struct Segment
+   {
+      unsigned last;
+      std::vector<Bar> bars;
+      std::list<Key>::iterator lru;
+   };
+
+   // segments of each table indexed by first date
+   std::map<std::string, std::map<unsigned,Segment>> tables;
+   // segments from most to least recently used
+   std::list<Key> lru;
+   std::size_t max_bytes;
+   std::size_t bytes;
+
+   // add Bars covering all dates [first,last] merging them with overlapping or adjacent segments, return merged segment
+   std::map<unsigned,Segment>::iterator insert(const std::string& tab_name, unsigned first, unsigned last, std::vector<Bar>&& bars);
+   // fetch Bars more recent than the last one of an open segment
+   template <class Fetch>
+   std::map<unsigned,Segment>::iterator refresh(const std::string& tab_name, std::map<unsigned,Segment>::iterator it, Fetch fetch);
+   // remove segment
+   void erase(const std::string& tab_name, std::map<unsigned,Segment>::iterator it);
+   // evict least recently used segments until memory cap is respected, keeping table segment starting at first
+   void evict(const std::string& tab_name, unsigned first);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor
+BarCache::BarCache(std::size_t max_bytes) : max_bytes(max_bytes), bytes(0) {}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get Bars from table with dates in [start_t,end_t], missing dates being read with fetch(start_t,end_t)
+template <class Fetch>
+std::vector<Bar> BarCache::get(const std::string& tab_name, unsigned start_t, unsigned end_t, Fetch fetch)
+{
+   if (start_t > end_t) return std::vector<Bar>();
+
+   // Bars can still be appended at or after the current time
+   if (end_t >= static_cast<unsigned>(time(nullptr))) end_t = OPEN;
+
+   std::map<unsigned,Segment>& segments = tables[tab_name];
+
+   // looking for dates not covered by cached segments
+   std::vector<std::pair<unsigned,unsigned>> gaps;
+   unsigned cur = start_t;
+   bool done = false;
+
+   auto it = segments.upper_bound(start_t);
+   if (it != segments.begin() && std::prev(it)->second.last >= start_t) --it;
+
+   for (; it != segments.end() && it->first <= end_t && !done; ++it) {
+      if (it->first > cur) gaps.emplace_back(cur, it->first - 1);
+      done = (it->second.last >= end_t);
+      if (!done) cur = it->second.last + 1;
+   }
+   if (!done) gaps.emplace_back(cur, end_t);
+
+   // reading missing dates
+   for (const auto& gap : gaps) {
+      std::vector<Bar> data = fetch(gap.first, gap.second);
+      unsigned last = gap.second;
+      if (last == end_t && end_t != OPEN) {
+         // Bars after the last one read may still be written, once their period is closed or by another connection
+         if (data.empty()) continue;
+         last = data.back().date;
+      }
+      insert(tab_name, gap.first, last, std::move(data));
+   }
+
+   // segment covering [start_t,end_t] now, up to its last Bar if the end of the read is not cached
+   it = segments.upper_bound(start_t);
+   if (it == segments.begin() || std::prev(it)->second.last < start_t) return std::vector<Bar>();
+   --it;
+
+   // reading Bars appended since last read if dates after the last cached Bar are requested
+   bool fetched_end = !gaps.empty() && gaps.back().second == OPEN;
+   if (it->second.last == OPEN && !fetched_end && (it->second.bars.empty() || end_t > it->second.bars.back().date)) {
+      it = refresh(tab_name, it, fetch);
+   }
+
+   const std::vector<Bar>& bars = it->second.bars;
+   auto first = std::lower_bound(bars.begin(), bars.end(), start_t, [](const Bar& x, unsigned t) { return x.date < t; });
+   auto last = std::upper_bound(first, bars.end(), end_t, [](unsigned t, const Bar& x) { return t < x.date; });
+   std::vector<Bar> data(first, last);
+
+   evict(tab_name, it->first);
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last n Bars from table (most recent first), reading them with fetch_last(n) if not cached
+template <class Fetch, class FetchLast>
+std::vector<Bar> BarCache::get_last(const std::string& tab_name, unsigned n, Fetch fetch, FetchLast fetch_last)
+{
+   std::map<unsigned,Segment>& segments = tables[tab_name];
+
+   auto it = segments.empty() ? segments.end() : std::prev(segments.end());
+
+   if (it != segments.end() && it->second.last == OPEN) {
+      // reading Bars appended since last read
+      it = refresh(tab_name, it, fetch);
+   }
+   if (it == segments.end() || it->second.last != OPEN || (it->second.bars.size() < n && it->first > 0)) {
+      // not enough Bars cached at the end of the table
+      std::vector<Bar> data = fetch_last(n);
+      // all dates from the oldest Bar returned are now known, or the whole table if fewer than n Bars
+      unsigned first = (data.size() < n || data.empty()) ? 0 : data.back().date;
+      std::reverse(data.begin(), data.end());
+      it = insert(tab_name, first, OPEN, std::move(data));
+   }
+
+   const std::vector<Bar>& bars = it->second.bars;
+   std::vector<Bar> data(bars.rbegin(), bars.rbegin() + std::min<std::size_t>(n, bars.size()));
+
+   evict(tab_name, it->first);
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove segments of table whose Bars may change after writing dates [start_t,end_t]
+// NB: Bars appended after the last Bar of an open segment do not invalidate it, they are read on next refresh
+void BarCache::invalidate(const std::string& tab_name, unsigned start_t, unsigned end_t)
+{
+   auto t = tables.find(tab_name);
+   if (t == tables.end()) return;
+
+   for (auto it = t->second.begin(); it != t->second.end();) {
+      auto next = std::next(it);
+      const Segment& seg = it->second;
+      bool append = (seg.last == OPEN && !seg.bars.empty() && start_t > seg.bars.back().date);
+      if (it->first <= end_t && seg.last >= start_t && !append) erase(tab_name, it);
+      it = next;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get memory used by cached Bars in bytes
+std::size_t BarCache::memory() const { return bytes; }
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add Bars covering all dates [first,last] merging them with overlapping or adjacent segments, return merged segment
+std::map<unsigned,BarCache::Segment>::iterator BarCache::insert(const std::string& tab_name, unsigned first, unsigned last, std::vector<Bar>&& bars)
+{
+   std::map<unsigned,Segment>& segments = tables[tab_name];
+
+   // first segment overlapping or adjacent to [first,last]
+   auto it = segments.upper_bound(first);
+   if (it != segments.begin() && (std::prev(it)->second.last >= first || std::prev(it)->second.last + 1 == first)) --it;
+
+   Segment merged;
+   merged.last = last;
+   unsigned merged_first = first;
+
+   // collecting Bars from segments before, after and inside [first,last], in date order
+   std::vector<Bar> before, after;
+   while (it != segments.end() && (last == OPEN || it->first <= last + 1)) {
+      Segment& seg = it->second;
+      merged_first = std::min(merged_first, it->first);
+      for (const auto& x : seg.bars) {
+         if (x.date < first) before.push_back(x);
+         else if (x.date > last) after.push_back(x);
+      }
+      merged.last = (seg.last == OPEN || last == OPEN) ? OPEN : std::max(merged.last, seg.last);
+      auto next = std::next(it);
+      erase(tab_name, it);
+      it = next;
+   }
+
+   merged.bars.reserve(before.size() + bars.size() + after.size());
+   merged.bars.insert(merged.bars.end(), before.begin(), before.end());
+   merged.bars.insert(merged.bars.end(), bars.begin(), bars.end());
+   merged.bars.insert(merged.bars.end(), after.begin(), after.end());
+
+   bytes += merged.bars.size() * sizeof(Bar);
+   lru.emplace_front(tab_name, merged_first);
+   merged.lru = lru.begin();
+
+   return segments.insert(std::make_pair(merged_first, std::move(merged))).first;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// fetch Bars more recent than the last one of an open segment
+template <class Fetch>
+std::map<unsigned,BarCache::Segment>::iterator BarCache::refresh(const std::string& tab_name, std::map<unsigned,Segment>::iterator it, Fetch fetch)
+{
+   unsigned from = it->second.bars.empty() ? it->first : it->second.bars.back().date + 1;
+   std::vector<Bar> data = fetch(from, OPEN);
+
+   if (data.empty()) {
+      // only marking segment as recently used
+      lru.splice(lru.begin(), lru, it->second.lru);
+      return it;
+   }
+   return insert(tab_name, from, OPEN, std::move(data));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove segment
+void BarCache::erase(const std::string& tab_name, std::map<unsigned,Segment>::iterator it)
+{
+   bytes -= it->second.bars.size() * sizeof(Bar);
+   lru.erase(it->second.lru);
+   tables[tab_name].erase(it);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// evict least recently used segments until memory cap is respected, keeping table segment starting at first
+void BarCache::evict(const std::string& tab_name, unsigned first)
+{
+   // marking segment as most recently used
+   std::map<unsigned,Segment>& segments = tables[tab_name];
+   auto it = segments.find(first);
+   lru.splice(lru.begin(), lru, it->second.lru);
+
+   while (bytes > max_bytes && lru.size() > 1) {
+      Key key = lru.back();
+      std::map<unsigned,Segment>& victims = tables[key.first];
+      erase(key.first, victims.find(key.second));
+      if (victims.empty()) tables.erase(key.first);
+   }
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,317 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef BARSERIES_HPP
+#define BARSERIES_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// vectorized kernels working on contiguous arrays of prices
+// NB: loops are kept simple so that they are vectorized by the compiler at -O3, min/max reductions
+// use SSE intrinsics as the compiler does not vectorize floating point reductions without -ffast-math
+
+// compute mid prices out[i] = (bid[i] + ask[i]) / 2 for i in [0,n)
+inline void mid_prices(const float* bid, const float* ask, float* out, std::size_t n)
+{
+   for (std::size_t i = 0; i < n; ++i) {
+      out[i] = 0.5f * (bid[i] + ask[i]);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// compute spreads out[i] = ask[i] - bid[i] for i in [0,n)
+inline void spreads(const float* bid, const float* ask, float* out, std::size_t n)
+{
+   for (std::size_t i = 0; i < n; ++i) {
+      out[i] = ask[i] - bid[i];
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// compute returns out[i] = x[i+1] / x[i] - 1 for i in [0,n-1)
+inline void returns(const float* x, float* out, std::size_t n)
+{
+   for (std::size_t i = 0; i + 1 < n; ++i) {
+      out[i] = x[i + 1] / x[i] - 1.0f;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get minimum value of x over [0,n), x must not be empty
+inline float min_value(const float* x, std::size_t n)
+{
+   std::size_t i = 0;
+   float m = x[0];
+#ifdef __SSE__
+   if (n >= 4) {
+      __m128 v = _mm_loadu_ps(x);
+      for (i = 4; i + 4 <= n; i += 4) {
+         v = _mm_min_ps(v, _mm_loadu_ps(x + i));
+      }
+      float buf[4];
+      _mm_storeu_ps(buf, v);
+      m = std::min(std::min(buf[0], buf[1]), std::min(buf[2], buf[3]));
+   }
+#endif
+   for (; i < n; ++i) {
+      m = std::min(m, x[i]);
+   }
+   return m;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get maximum value of x over [0,n), x must not be empty
+inline float max_value(const float* x, std::size_t n)
+{
+   std::size_t i = 0;
+   float m = x[0];
+#ifdef __SSE__
+   if (n >= 4) {
+      __m128 v = _mm_loadu_ps(x);
+      for (i = 4; i + 4 <= n; i += 4) {
+         v = _mm_max_ps(v, _mm_loadu_ps(x + i));
+      }
+      float buf[4];
+      _mm_storeu_ps(buf, v);
+      m = std::max(std::max(buf[0], buf[1]), std::max(buf[2], buf[3]));
+   }
+#endif
+   for (; i < n; ++i) {
+      m = std::max(m, x[i]);
+   }
+   return m;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// series of Bars stored by columns (structure of arrays) so that computations 
+// only touching a few fields do not load the others into cache
+
+class BarSeries
+{
+public:
+   // price types
+   enum Price {OPEN, HIGH, LOW, CLOSE};
+
+   std::vector<unsigned> date;
+   std::vector<float> openBid, openAsk;
+   std::vector<float> highBid, highAsk;
+   std::vector<float> lowBid, lowAsk;
+   std::vector<float> closeBid, closeAsk;
+   std::vector<unsigned> volume;
+
+   // nullary constructor
+   BarSeries() {}
+   // parameter constructor from vector of Bars
+   explicit BarSeries(const std::vector<Bar>& data);
+   // convert to vector of Bars
+   std::vector<Bar> toBars() const;
+   // get number of Bars
+   std::size_t size() const;
+   // reserve memory for n Bars
+   void reserve(std::size_t n);
+   // remove all Bars
+   void clear();
+   // append Bar
+   void push_back(const Bar& x);
+   // get Bar at position i
+   Bar getBar(std::size_t i) const;
+   // get bid column of a price type
+   const std::vector<float>& getBid(Price p) const;
+   // get ask column of a price type
+   const std::vector<float>& getAsk(Price p) const;
+   // get mid prices of a price type on positions [first,last)
+   std::vector<float> getMid(Price p, std::size_t first = 0, std::size_t last = -1) const;
+   // get spreads of a price type on positions [first,last)
+   std::vector<float> getSpread(Price p, std::size_t first = 0, std::size_t last = -1) const;
+   // get mid price returns of a price type on positions [first,last), one less than number of Bars
+   std::vector<float> getReturns(Price p, std::size_t first = 0, std::size_t last = -1) const;
+   // get lowest mid low price on positions [first,last)
+   float getMin(std::size_t first = 0, std::size_t last = -1) const;
+   // get highest mid high price on positions [first,last)
+   float getMax(std::size_t first = 0, std::size_t last = -1) const;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor from vector of Bars
+BarSeries::BarSeries(const std::vector<Bar>& data)
+{
+   reserve(data.size());
+   for (const auto& x : data) {
+      push_back(x);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert to vector of Bars
+std::vector<Bar> BarSeries::toBars() const
+{
+   std::vector<Bar> data;
+   data.reserve(size());
+   for (std::size_t i = 0; i < size(); ++i) {
+      data.push_back(getBar(i));
+   }
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get number of Bars
+std::size_t BarSeries::size() const { return date.size(); }
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// reserve memory for n Bars
+void BarSeries::reserve(std::size_t n)
+{
+   date.reserve(n);
+   openBid.reserve(n);
+   openAsk.reserve(n);
+   highBid.reserve(n);
+   highAsk.reserve(n);
+   lowBid.reserve(n);
+   lowAsk.reserve(n);
+   closeBid.reserve(n);
+   closeAsk.reserve(n);
+   volume.reserve(n);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove all Bars
+void BarSeries::clear()
+{
+   date.clear();
+   openBid.clear();
+   openAsk.clear();
+   highBid.clear();
+   highAsk.clear();
+   lowBid.clear();
+   lowAsk.clear();
+   closeBid.clear();
+   closeAsk.clear();
+   volume.clear();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append Bar
+void BarSeries::push_back(const Bar& x)
+{
+   date.push_back(x.date);
+   openBid.push_back(x.openBid);
+   openAsk.push_back(x.openAsk);
+   highBid.push_back(x.highBid);
+   highAsk.push_back(x.highAsk);
+   lowBid.push_back(x.lowBid);
+   lowAsk.push_back(x.lowAsk);
+   closeBid.push_back(x.closeBid);
+   closeAsk.push_back(x.closeAsk);
+   volume.push_back(x.volume);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get Bar at position i
+Bar BarSeries::getBar(std::size_t i) const
+{
+   return Bar(date[i], openBid[i], openAsk[i], highBid[i], highAsk[i], lowBid[i], lowAsk[i], closeBid[i], closeAsk[i], volume[i]);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get bid column of a price type
+const std::vector<float>& BarSeries::getBid(Price p) const
+{
+   switch (p) {
+      case OPEN: return openBid;
+      case HIGH: return highBid;
+      case LOW: return lowBid;
+      default: return closeBid;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get ask column of a price type
+const std::vector<float>& BarSeries::getAsk(Price p) const
+{
+   switch (p) {
+      case OPEN: return openAsk;
+      case HIGH: return highAsk;
+      case LOW: return lowAsk;
+      default: return closeAsk;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get mid prices of a price type on positions [first,last)
+std::vector<float> BarSeries::getMid(Price p, std::size_t first, std::size_t last) const
+{
+   last = std::min(last, size());
+   std::vector<float> out(first < last ? last - first : 0);
+   if (!out.empty()) {
+      mid_prices(&getBid(p)[first], &getAsk(p)[first], &out[0], out.size());
+   }
+   return out;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get spreads of a price type on positions [first,last)
+std::vector<float> BarSeries::getSpread(Price p, std::size_t first, std::size_t last) const
+{
+   last = std::min(last, size());
+   std::vector<float> out(first < last ? last - first : 0);
+   if (!out.empty()) {
+      spreads(&getBid(p)[first], &getAsk(p)[first], &out[0], out.size());
+   }
+   return out;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get mid price returns of a price type on positions [first,last), one less than number of Bars
+std::vector<float> BarSeries::getReturns(Price p, std::size_t first, std::size_t last) const
+{
+   std::vector<float> mid = getMid(p, first, last);
+   std::vector<float> out(mid.size() > 1 ? mid.size() - 1 : 0);
+   if (!out.empty()) {
+      returns(&mid[0], &out[0], mid.size());
+   }
+   return out;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get lowest mid low price on positions [first,last)
+float BarSeries::getMin(std::size_t first, std::size_t last) const
+{
+   std::vector<float> mid = getMid(LOW, first, last);
+   return mid.empty() ? std::numeric_limits<float>::quiet_NaN() : min_value(&mid[0], mid.size());
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get highest mid high price on positions [first,last)
+float BarSeries::getMax(std::size_t first, std::size_t last) const
+{
+   std::vector<float> mid = getMid(HIGH, first, last);
+   return mid.empty() ? std::numeric_limits<float>::quiet_NaN() : max_value(&mid[0], mid.size());
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef BARSTORE_HPP
+#define BARSTORE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// range of Bars sorted by date stored contiguously in memory, it remains valid 
+// as long as the store it comes from is neither destroyed nor appended to
+
+class BarRange
+{
+public:
+   // parameter constructor
+   BarRange(const Bar* first = nullptr, const Bar* last = nullptr) : first(first), last(last) {}
+   // iterators on Bars
+   const Bar* begin() const { return first; }
+   const Bar* end() const { return last; }
+   // get number of Bars
+   std::size_t size() const { return last - first; }
+   // check whether range is empty
+   bool empty() const { return first == last; }
+   // get Bar at position i
+   const Bar& operator[](std::size_t i) const { return first[i]; }
+   // copy Bars into a vector
+   std::vector<Bar> toVector() const { return std::vector<Bar>(first, last); }
+
+private:
+   const Bar* first;
+   const Bar* last;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// local binary copy of a table from database, Bars are stored as fixed width records sorted by date
+// in a file mapped into memory, so that reads are binary searches returning Bars without any copy
+
+class BarStore
+{
+public:
+   // parameter constructor, open or create the file storing table tab_name in directory dir
+   BarStore(const std::string& dir, const std::string& tab_name);
+   // destructor
+   ~BarStore();
+   // append Bars from table in database more recent than the last stored Bar, return number of Bars added
+   std::size_t sync(DataBase& db);
+   // append Bars sorted by date, Bars not more recent than the last stored Bar are skipped
+   std::size_t append(const std::vector<Bar>& data, std::size_t start = 0);
+   // read full table
+   BarRange read_table() const;
+   // read table from a given start date (included)
+   BarRange read_table(const std::string& start_date) const;
+   // read table between a given start date and a given end date (included)
+   BarRange read_table(const std::string& start_date, const std::string& end_date) const;
+   // get last n Bars (NB: unlike DataBase, most recent Bar is the last one in the range)
+   BarRange read_table(unsigned n) const;
+   // get last Bar, the store must not be empty
+   const Bar& get_last_row() const;
+   // get number of Bars stored
+   std::size_t size() const;
+   // get path of the file storing table tab_name in directory dir
+   static std::string file_path(const std::string& dir, const std::string& tab_name) { return dir + "/" + tab_name + ".bars"; }
+
+private:
+   // file header
+   struct Header
+   {
+      char magic[8];
+      std::uint32_t record_size;
+      std::uint32_t reserved;
+      std::uint64_t count;
+   };
+
+   std::string tab_name;
+   std::string path;
+   int fd;
+   // mapped file content
+   void* map;
+   std::size_t map_size;
+   // number of Bars stored
+   std::size_t count;
+
+   BarStore(const BarStore&);
+   BarStore& operator=(const BarStore&);
+
+   // map file content into memory
+   void remap();
+   // get first stored Bar
+   const Bar* bars() const;
+   // get range of Bars with dates in [start_t,end_t]
+   BarRange range(unsigned start_t, unsigned end_t) const;
+   // throw exception reporting last system error
+   void error(const std::string& what) const;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, open or create the file storing table tab_name in directory dir
+BarStore::BarStore(const std::string& dir, const std::string& tab_name) : tab_name(tab_name), fd(-1), map(MAP_FAILED), map_size(0), count(0)
+{
+   static_assert(sizeof(Bar) == 40 && std::is_trivially_copyable<Bar>::value, "Bar must be a 40 bytes POD record");
+
+   mkdir(dir.c_str(), 0755);
+   path = file_path(dir, tab_name);
+
+   fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+   if (fd < 0) error("open");
+
+   Header h = {};
+   ssize_t n = pread(fd, &h, sizeof(h), 0);
+
+   if (n == 0) {
+      // new file
+      std::memcpy(h.magic, "QDBBARS1", 8);
+      h.record_size = sizeof(Bar);
+      if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h)) error("pwrite");
+   }
+   else if (n != sizeof(h) || std::memcmp(h.magic, "QDBBARS1", 8) != 0 || h.record_size != sizeof(Bar)) {
+      close(fd);
+      throw std::runtime_error("BarStore: " + path + " is not a valid Bar store");
+   }
+   // dropping any record written after the last header update, for instance by an interrupted append
+   count = h.count;
+   if (ftruncate(fd, sizeof(Header) + count * sizeof(Bar)) != 0) error("ftruncate");
+
+   remap();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// destructor
+BarStore::~BarStore()
+{
+   if (map != MAP_FAILED) munmap(map, map_size);
+   if (fd >= 0) close(fd);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append Bars from table in database more recent than the last stored Bar, return number of Bars added
+std::size_t BarStore::sync(DataBase& db)
+{
+   std::string start = count ? sec_to_string(get_last_row().date + 1) : sec_to_string(0);
+   // streaming Bars by chunks so that memory does not depend on the number of Bars to add
+   DataBase::Cursor cursor = db.open_cursor(tab_name, start, sec_to_string(std::numeric_limits<unsigned>::max()));
+   std::vector<Bar> data;
+   std::size_t n = 0;
+
+   while (cursor.next(data)) {
+      n += append(data);
+   }
+
+   return n;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append Bars sorted by date, Bars not more recent than the last stored Bar are skipped
+std::size_t BarStore::append(const std::vector<Bar>& data, std::size_t start)
+{
+   // skipping Bars already stored
+   if (count) {
+      unsigned last_date = get_last_row().date;
+      while (start < data.size() && data[start].date <= last_date) ++start;
+   }
+   if (start >= data.size()) return 0;
+
+   // writing records first, then header, so that the store stays consistent if interrupted
+   std::size_t n = data.size() - start;
+   const char* p = reinterpret_cast<const char*>(&data[start]);
+   std::size_t nb_bytes = n * sizeof(Bar);
+   off_t offset = sizeof(Header) + count * sizeof(Bar);
+
+   while (nb_bytes > 0) {
+      ssize_t k = pwrite(fd, p, nb_bytes, offset);
+      if (k < 0) {
+         if (errno == EINTR) continue;
+         error("pwrite");
+      }
+      p += k;
+      offset += k;
+      nb_bytes -= k;
+   }
+   if (fdatasync(fd) != 0) error("fdatasync");
+
+   std::uint64_t new_count = count + n;
+   if (pwrite(fd, &new_count, sizeof(new_count), offsetof(Header, count)) != sizeof(new_count)) error("pwrite");
+   count = new_count;
+
+   remap();
+
+   return n;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read full table
+BarRange BarStore::read_table() const
+{
+   return BarRange(bars(), bars() + count);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table from a given start date (included)
+BarRange BarStore::read_table(const std::string& start_date) const
+{
+   return range(string_to_sec(start_date), std::numeric_limits<unsigned>::max());
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table between a given start date and a given end date (included)
+BarRange BarStore::read_table(const std::string& start_date, const std::string& end_date) const
+{
+   return range(string_to_sec(start_date), string_to_sec(end_date));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last n Bars (NB: unlike DataBase, most recent Bar is the last one in the range)
+BarRange BarStore::read_table(unsigned n) const
+{
+   return BarRange(bars() + count - std::min<std::size_t>(n, count), bars() + count);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last Bar, the store must not be empty
+const Bar& BarStore::get_last_row() const
+{
+   return bars()[count - 1];
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get number of Bars stored
+std::size_t BarStore::size() const { return count; }
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// map file content into memory
+void BarStore::remap()
+{
+   if (map != MAP_FAILED) {
+      munmap(map, map_size);
+      map = MAP_FAILED;
+   }
+   map_size = sizeof(Header) + count * sizeof(Bar);
+   map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED) error("mmap");
+   // Bars are mostly read sequentially
+   madvise(map, map_size, MADV_SEQUENTIAL);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get first stored Bar
+const Bar* BarStore::bars() const
+{
+   return reinterpret_cast<const Bar*>(static_cast<const char*>(map) + sizeof(Header));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get range of Bars with dates in [start_t,end_t]
+BarRange BarStore::range(unsigned start_t, unsigned end_t) const
+{
+   const Bar* first = std::lower_bound(bars(), bars() + count, start_t, [](const Bar& x, unsigned t) { return x.date < t; });
+   const Bar* last = std::upper_bound(first, bars() + count, end_t, [](unsigned t, const Bar& x) { return t < x.date; });
+
+   return BarRange(first, last);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// throw exception reporting last system error
+void BarStore::error(const std::string& what) const
+{
+   throw std::runtime_error("BarStore: " + what + " failed on " + path + ": " + std::strerror(errno));
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef CANDLEPARSER_HPP
+#define CANDLEPARSER_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// candle as returned by Oanda in bidask format
+
+struct Candle
+{
+   unsigned date;
+   float openBid, openAsk;
+   float highBid, highAsk;
+   float lowBid, lowAsk;
+   float closeBid, closeAsk;
+   unsigned volume;
+   bool complete;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// streaming parser for the candles array of an Oanda response, the response can be fed by chunks 
+// of any size as it is received, candles are decoded in place without any heap allocation
+
+class CandleParser
+{
+public:
+   // nullary constructor
+   CandleParser();
+   // reset parser for a new response
+   void reset();
+   // parse next chunk of the response calling f(const Candle&) for each candle decoded
+   template <class F>
+   void feed(const char* p, std::size_t n, F f);
+   // return true once the end of the candles array has been reached
+   bool done() const;
+
+private:
+   enum State {SEARCH_KEY, SEARCH_ARRAY, IN_ARRAY, IN_CANDLE, DONE};
+
+   State state;
+   // number of characters of the candles key matched so far
+   std::size_t key_pos;
+   // candle split between two chunks
+   char carry[512];
+   std::size_t carry_len;
+
+   // decode candle object between braces [p,end)
+   static void parseCandle(const char* p, const char* end, Candle& c);
+   // decode JSON number starting at p
+   static double parseNumber(const char*& p, const char* end);
+   // decode Oanda date in format YYYY-mm-ddTHH:MM:SS[.ffffff]Z into seconds since epoch
+   static unsigned parseDate(const char* p, const char* end);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// nullary constructor
+CandleParser::CandleParser() { reset(); }
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// reset parser for a new response
+void CandleParser::reset()
+{
+   state = SEARCH_KEY;
+   key_pos = 0;
+   carry_len = 0;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// return true once the end of the candles array has been reached
+bool CandleParser::done() const { return state == DONE; }
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parse next chunk of the response calling f(const Candle&) for each candle decoded
+template <class F>
+void CandleParser::feed(const char* p, std::size_t n, F f)
+{
+   static const char key[] = "\"candles\"";
+
+   const char* end = p + n;
+   Candle c;
+
+   while (p < end) {
+      switch (state) {
+         case SEARCH_KEY:
+            // matching the candles key, possibly across chunks
+            for (; p < end && key[key_pos] != '\0'; ++p) {
+               key_pos = (*p == key[key_pos]) ? key_pos + 1 : (*p == key[0]);
+            }
+            if (key[key_pos] == '\0') state = SEARCH_ARRAY;
+            break;
+         case SEARCH_ARRAY:
+            for (; p < end && *p != '['; ++p) {}
+            if (p < end) {
+               state = IN_ARRAY;
+               ++p;
+            }
+            break;
+         case IN_ARRAY:
+            for (; p < end && *p != '{' && *p != ']'; ++p) {}
+            if (p < end) {
+               state = (*p == '{') ? IN_CANDLE : DONE;
+               if (state == DONE) return;
+            }
+            break;
+         case IN_CANDLE: {
+            // candle objects contain neither nested objects nor braces in strings
+            const char* q = static_cast<const char*>(std::memchr(p, '}', end - p));
+            std::size_t len = (q ? q + 1 : end) - p;
+            if (carry_len == 0 && q) {
+               // whole candle in current chunk, decoding it in place
+               parseCandle(p, q + 1, c);
+               f(static_cast<const Candle&>(c));
+            }
+            else {
+               if (carry_len + len > sizeof(carry)) {
+                  throw std::runtime_error("CandleParser: candle object too large");
+               }
+               std::memcpy(carry + carry_len, p, len);
+               carry_len += len;
+               if (q) {
+                  parseCandle(carry, carry + carry_len, c);
+                  f(static_cast<const Candle&>(c));
+                  carry_len = 0;
+               }
+            }
+            p += len;
+            if (q) state = IN_ARRAY;
+            break;
+         }
+         case DONE:
+            return;
+      }
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// decode candle object between braces [p,end)
+void CandleParser::parseCandle(const char* p, const char* end, Candle& c)
+{
+   c = Candle();
+
+   while (p < end) {
+      // reading key
+      for (; p < end && *p != '"'; ++p) {}
+      if (p == end) break;
+      const char* k = ++p;
+      for (; p < end && *p != '"'; ++p) {}
+      std::size_t klen = p - k;
+      // reading value
+      for (++p; p < end && (*p == ':' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'); ++p) {}
+      if (p >= end) break;
+
+      if (*p == '"') {
+         const char* v = ++p;
+         for (; p < end && *p != '"'; ++p) {}
+         if (klen == 4 && std::memcmp(k, "time", 4) == 0) {
+            c.date = parseDate(v, p);
+         }
+         ++p;
+      }
+      else if (*p == 't' || *p == 'f') {
+         if (klen == 8 && std::memcmp(k, "complete", 8) == 0) {
+            c.complete = (*p == 't');
+         }
+         for (; p < end && *p >= 'a' && *p <= 'z'; ++p) {}
+      }
+      else {
+         double x = parseNumber(p, end);
+         // dispatching on key length then on first letter
+         switch (klen) {
+            case 6:
+               if (k[0] == 'v') c.volume = static_cast<unsigned>(x);
+               else if (k[3] == 'B') c.lowBid = x;
+               else c.lowAsk = x;
+               break;
+            case 7:
+               if (k[0] == 'o') (k[4] == 'B' ? c.openBid : c.openAsk) = x;
+               else (k[4] == 'B' ? c.highBid : c.highAsk) = x;
+               break;
+            case 8:
+               (k[5] == 'B' ? c.closeBid : c.closeAsk) = x;
+               break;
+         }
+      }
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// decode JSON number starting at p
+double CandleParser::parseNumber(const char*& p, const char* end)
+{
+   // exact powers of ten in double precision
+   static const double pow10[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                                  1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+   const char* start = p;
+   bool neg = (p < end && *p == '-');
+   if (neg) ++p;
+
+   unsigned long long m = 0;
+   int nb_digits = 0;
+   int scale = 0;
+
+   for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nb_digits) {
+      m = 10 * m + (*p - '0');
+   }
+   if (p < end && *p == '.') {
+      for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++nb_digits, ++scale) {
+         m = 10 * m + (*p - '0');
+      }
+   }
+   // fast path: mantissa and power of ten are both exact in double precision so that 
+   // a single division gives the correctly rounded result, as strtod would
+   if (p < end && (*p == 'e' || *p == 'E')) {
+      nb_digits = 20;
+   }
+   if (nb_digits <= 15 && scale <= 22) {
+      double x = static_cast<double>(m) / pow10[scale];
+      return neg ? -x : x;
+   }
+   // slow path for exponents and long mantissas
+   char buf[64];
+   for (; p < end && ((*p >= '0' && *p <= '9') || *p == 'e' || *p == 'E' || *p == '+' || *p == '-' || *p == '.'); ++p) {}
+   std::size_t len = std::min<std::size_t>(p - start, sizeof(buf) - 1);
+   std::memcpy(buf, start, len);
+   buf[len] = '\0';
+   return std::strtod(buf, nullptr);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// decode Oanda date in format YYYY-mm-ddTHH:MM:SS[.ffffff]Z into seconds since epoch
+unsigned CandleParser::parseDate(const char* p, const char* end)
+{
+   if (end - p < 19) {
+      throw std::runtime_error("CandleParser: invalid candle time");
+   }
+   // same digit positions as format YYYY-mm-dd HH:MM:SS
+   return parse_date(p);
+}
+
+//=================================================================================================
+
+}
+
+#endif
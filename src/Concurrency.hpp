@@ -0,0 +1,162 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef CONCURRENCY_HPP
+#define CONCURRENCY_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// thread safe FIFO queue holding at most capacity elements, push blocks while the queue is full
+// and pop blocks while it is empty, until the queue is closed
+
+template <class T>
+class BoundedQueue
+{
+public:
+   // parameter constructor
+   explicit BoundedQueue(std::size_t capacity);
+   // add element to the queue, return false if the queue has been closed
+   bool push(T&& x);
+   // remove first element from the queue, return false once the queue is closed and empty
+   bool pop(T& x);
+   // close the queue, waking up all waiting threads
+   void close();
+
+private:
+   std::deque<T> items;
+   std::size_t capacity;
+   bool closed;
+   std::mutex m;
+   std::condition_variable not_full;
+   std::condition_variable not_empty;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor
+template <class T>
+BoundedQueue<T>::BoundedQueue(std::size_t capacity) : capacity(std::max<std::size_t>(capacity, 1)), closed(false) {}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add element to the queue, return false if the queue has been closed
+template <class T>
+bool BoundedQueue<T>::push(T&& x)
+{
+   std::unique_lock<std::mutex> lock(m);
+   not_full.wait(lock, [this]() { return closed || items.size() < capacity; });
+   if (closed) return false;
+   items.push_back(std::move(x));
+   not_empty.notify_one();
+   return true;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove first element from the queue, return false once the queue is closed and empty
+template <class T>
+bool BoundedQueue<T>::pop(T& x)
+{
+   std::unique_lock<std::mutex> lock(m);
+   not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+   if (items.empty()) return false;
+   x = std::move(items.front());
+   items.pop_front();
+   not_full.notify_one();
+   return true;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// close the queue, waking up all waiting threads
+template <class T>
+void BoundedQueue<T>::close()
+{
+   std::lock_guard<std::mutex> lock(m);
+   closed = true;
+   not_full.notify_all();
+   not_empty.notify_all();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// run function f on nb_threads threads and wait for all of them to finish
+// the first exception thrown by any thread is rethrown once every thread has been joined
+template <class F>
+void run_threads(int nb_threads, F f)
+{
+   std::vector<std::thread> threads;
+   std::exception_ptr error;
+   std::mutex error_mutex;
+
+   for (int i = 0; i < std::max(nb_threads, 1); ++i) {
+      threads.emplace_back([&]() {
+         try {
+            f();
+         } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
+         }
+      });
+   }
+   for (auto& t : threads) {
+      t.join();
+   }
+   if (error) {
+      std::rethrow_exception(error);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// call f(i) for i from 0 to n - 1 on at most nb_threads threads, each thread taking the next index as soon
+// as it is done with the previous one, enter() and leave() being called by each thread before its first
+// index and after its last one, even if f throws
+template <class F, class Enter, class Leave>
+void for_each_parallel(int nb_threads, std::size_t n, F f, Enter enter, Leave leave)
+{
+   // index of the next call to be made by the first available thread
+   std::atomic<std::size_t> next(0);
+
+   struct Guard {
+      Leave& leave;
+      ~Guard() { leave(); }
+   };
+
+   run_threads(static_cast<int>(std::min<std::size_t>(std::max(nb_threads, 1), n)), [&]() {
+      enter();
+      Guard guard = {leave};
+      for (std::size_t i = next++; i < n; i = next++) {
+         f(i);
+      }
+   });
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// call f(i) for i from 0 to n - 1 on at most nb_threads threads
+template <class F>
+void for_each_parallel(int nb_threads, std::size_t n, F f)
+{
+   for_each_parallel(nb_threads, n, f, []() {}, []() {});
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// output a message to the console without interleaving with messages from other threads
+void print(const std::string& msg)
+{
+   static std::mutex print_mutex;
+
+   std::lock_guard<std::mutex> lock(print_mutex);
+   std::cout << msg << std::flush;
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,211 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef CONNECTIONPOOL_HPP
+#define CONNECTIONPOOL_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// thread safe pool of connections to a MySQL database, connections are lent to DataBase objects
+// along with the statements prepared on them and given back when these objects are destroyed,
+// so that the connection setup (TCP handshake, authentication, schema selection) is paid once
+
+class ConnectionPool
+{
+public:
+   // connection lent by the pool with the statements prepared on it
+   struct Connection
+   {
+      std::unique_ptr<sql::Connection> con;
+      std::unique_ptr<sql::Statement> stmt;
+      // prepared multi-row INSERT statements indexed by table name, number of rows and whether they ignore duplicates
+      std::map<std::tuple<std::string,int,bool>, std::unique_ptr<sql::PreparedStatement>> insert_stmts;
+   };
+
+   // parameter constructor, open min_size connections to database db_name, at most max_size can be open at once
+   ConnectionPool(const std::string& db_name, int min_size = POOL_MIN_SIZE, int max_size = POOL_MAX_SIZE);
+   // get a connection checked to be alive, waiting for one to be released if max_size connections are in use
+   Connection acquire();
+   // give back a connection, it is closed if it is no longer usable
+   void release(Connection&& c);
+   // get name of the database
+   const std::string& database() const { return db_name; }
+   // get number of connections currently open, lent or idle
+   int size() const;
+   // get number of idle connections
+   int idle() const;
+   // open a new connection to database db_name outside of any pool, 
+   // loading local files (LOAD DATA LOCAL INFILE) being allowed
+   static sql::Connection* open(const std::string& db_name);
+
+private:
+   std::string db_name;
+   int min_size;
+   int max_size;
+   // number of connections open, lent or idle
+   int nb_open;
+   // connections waiting to be lent, the most recently released last
+   std::vector<Connection> connections;
+   mutable std::mutex m;
+   std::condition_variable released;
+
+   // open a new connection to database
+   Connection connect() const;
+   // check that a connection is alive and in a clean state
+   static bool is_valid(Connection& c);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, open min_size connections to database db_name, at most max_size can be open at once
+ConnectionPool::ConnectionPool(const std::string& db_name, int min_size, int max_size)
+   : db_name(db_name), min_size(std::max(min_size, 0)), max_size(std::max(max_size, 1)), nb_open(0)
+{
+   this->min_size = std::min(this->min_size, this->max_size);
+
+   try {
+      for (int i = 0; i < this->min_size; ++i) {
+         connections.push_back(connect());
+         ++nb_open;
+      }
+   } catch (sql::SQLException &e) {
+      // remaining connections will be opened on demand
+      print(std::string("ERROR: cannot open connection to ") + db_name + ": " + e.what() + "\n");
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get a connection checked to be alive, waiting for one to be released if max_size connections are in use
+ConnectionPool::Connection ConnectionPool::acquire()
+{
+   std::unique_lock<std::mutex> lock(m);
+
+   for (;;) {
+      released.wait(lock, [this]() { return !connections.empty() || nb_open < max_size; });
+
+      if (connections.empty()) {
+         // opening a new connection outside the lock
+         ++nb_open;
+         lock.unlock();
+         try {
+            return connect();
+         } catch (...) {
+            lock.lock();
+            --nb_open;
+            released.notify_one();
+            throw;
+         }
+      }
+
+      Connection c = std::move(connections.back());
+      connections.pop_back();
+      lock.unlock();
+
+      if (is_valid(c)) return c;
+
+      // dropping dead connection (statements are destroyed before it) and trying again
+      { Connection dead = std::move(c); }
+      lock.lock();
+      --nb_open;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// give back a connection, it is closed if it is no longer usable
+void ConnectionPool::release(Connection&& c)
+{
+   bool valid = c.con && is_valid(c);
+
+   if (!valid) {
+      // closing outside the lock
+      Connection dead = std::move(c);
+   }
+
+   std::lock_guard<std::mutex> lock(m);
+   if (valid) {
+      connections.push_back(std::move(c));
+   }
+   else {
+      --nb_open;
+   }
+   released.notify_one();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get number of connections currently open, lent or idle
+int ConnectionPool::size() const
+{
+   std::lock_guard<std::mutex> lock(m);
+   return nb_open;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get number of idle connections
+int ConnectionPool::idle() const
+{
+   std::lock_guard<std::mutex> lock(m);
+   return connections.size();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// open a new connection to database db_name outside of any pool, loading local files being allowed
+sql::Connection* ConnectionPool::open(const std::string& db_name)
+{
+   sql::ConnectOptionsMap options;
+   options["hostName"] = sql::SQLString(URL);
+   options["userName"] = sql::SQLString(USER);
+   options["password"] = sql::SQLString(PASSWORD);
+   // NB: the server must also accept local files (local_infile = ON) for bulk loading
+   options["OPT_LOCAL_INFILE"] = 1;
+
+   sql::Driver* driver = get_driver_instance();
+   std::unique_ptr<sql::Connection> con(driver->connect(options));
+   con->setSchema(db_name);
+
+   return con.release();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// open a new connection to database
+ConnectionPool::Connection ConnectionPool::connect() const
+{
+   Connection c;
+
+   c.con.reset(open(db_name));
+   c.stmt.reset(c.con->createStatement());
+
+   return c;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// check that a connection is alive and in a clean state
+bool ConnectionPool::is_valid(Connection& c)
+{
+   try {
+      if (c.con->isClosed() || !c.con->isValid()) return false;
+      // a transaction left open by a failed write is rolled back
+      if (!c.con->getAutoCommit()) {
+         c.con->rollback();
+         c.con->setAutoCommit(true);
+      }
+      return true;
+   } catch (sql::SQLException&) {
+      return false;
+   }
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -9,52 +9,428 @@ namespace qdb {
 
 //=================================================================================================
 
-// class for interacting with MySQL database
+// class for interacting with MySQL database, the default storage engine (see Storage)
 
-class DataBase
+class DataBase : public Storage
 {
 public:
+   // cursor streaming Bars from a table by chunks of fixed size, rows being read from the server 
+   // as they are consumed (unbuffered result set) so that memory does not depend on table size
+   // NB: the connection it comes from cannot run other queries until the cursor is exhausted or destroyed
+   class Cursor
+   {
+   public:
+      // read next chunk of at most chunk_size Bars into data (previous content is cleared), 
+      // return false once all Bars have been read
+      bool next(std::vector<Bar>& data);
+
+   private:
+      friend class DataBase;
+
+      std::unique_ptr<sql::Statement> stmt;
+      std::unique_ptr<sql::ResultSet> res;
+      std::size_t chunk_size;
+      // scale of prices stored as integers, 0 if stored as floats
+      int scale;
+
+      // parameter constructor
+      Cursor(sql::Connection* con, const std::string& query, std::size_t chunk_size, int scale);
+   };
+
+   // NB: layouts of price columns (PriceFormat) and partitionings of tables (Partitioning) are defined in Storage
+
+   // writer (re)building a whole table at once: Bars are appended to a local file in the bulk format,
+   // when committed they are loaded (LOAD DATA LOCAL INFILE) into a staging table without key, the key
+   // is built once and the staging table replaces the table by an atomic RENAME, so that readers keep
+   // seeing the previous table until the new one is complete
+   // NB: the writer must not outlive the DataBase object it comes from
+   class BulkWriter
+   {
+   public:
+      // move constructor
+      BulkWriter(BulkWriter&& other);
+      // destructor, discard Bars written if not committed
+      ~BulkWriter();
+      // append Bars from position start in vector, Bars not more recent than the last one written are skipped
+      void write(const std::vector<Bar>& data, int start = 0);
+      // load Bars written and replace table, return number of Bars loaded, throw std::runtime_error if loading
+      // fails, the table being left unchanged
+      std::size_t commit();
+
+   private:
+      friend class DataBase;
+
+      DataBase* db;
+      std::string tab_name;
+      // path of the local file
+      std::string path;
+      FILE* file;
+      // scale of prices stored as integers, 0 if stored as floats
+      int scale;
+      Partitioning partitioning;
+      // dates of the first and last Bars written
+      unsigned first_date;
+      unsigned last_date;
+      // number of Bars written
+      std::size_t count;
+
+      // parameter constructor
+      BulkWriter(DataBase* db, const std::string& tab_name, int scale, Partitioning partitioning);
+      // close and remove local file
+      void discard();
+   };
+
+   // MySQL driver initialized for the calling thread from construction to destruction (see thread_init)
+   class ThreadScope
+   {
+   public:
+      // default constructor
+      ThreadScope();
+      // destructor
+      ~ThreadScope();
+   };
+
+
    // parameter constructor
    DataBase(const std::string& db_name);
-   // create or re-initialize a table in database to contain Bars
-   void create_table(const std::string& tab_name);
-   // write to table in database appending new Bars
-   void write_table(const std::string& tab_name, const std::vector<Bar>& data, int start = 0);
+   // parameter constructor, borrow a connection from pool until destruction
+   // NB: cursors opened must not outlive the object as the connection is given back to the pool
+   DataBase(ConnectionPool& pool);
+   // destructor
+   ~DataBase();
+   // create or re-initialize a table in database to contain Bars, with prices stored in the given format
+   // and partitioned by ranges of dates
+   void create_table(const std::string& tab_name, PriceFormat format = FLOAT_PRICES, Partitioning partitioning = NO_PARTITIONS) override;
+   // get scale of prices stored as integers in table (see price_scale in Bar.hpp), 0 if stored as floats
+   int get_price_scale(const std::string& tab_name);
+   // get partitioning of table
+   Partitioning get_partitioning(const std::string& tab_name);
+   // get writer (re)building table at once from Bars in the given price format and partitioning, see BulkWriter
+   BulkWriter bulk_writer(const std::string& tab_name, PriceFormat format = FLOAT_PRICES, Partitioning partitioning = NO_PARTITIONS);
+   // remove Bars between a given start date and a given end date (included) before writing them again, 
+   // partitions of a partitioned table entirely within the range are emptied at once
+   void clear_range(const std::string& tab_name, const std::string& start_date, const std::string& end_date);
+   // write to table in database appending new Bars, throw std::out_of_range if a price does not fit the integer columns,
+   // Bars whose date is already recorded being skipped if skip_existing (INSERT IGNORE), rolled back with the others otherwise
+   void write_table(const std::string& tab_name, const std::vector<Bar>& data, int start = 0, bool skip_existing = false) override;
+   // set maximum number of Bars sent per multi-row INSERT statement
+   void set_batch_size(int batch_size);
    // read table from database and record the data into a vector of Bars
-   std::vector<Bar> read_table(const std::string& tab_name);
+   std::vector<Bar> read_table(const std::string& tab_name) override;
    // read table from database from a given start date (included)
-   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date);
+   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date) override;
    // read table from database between a given start date and a given end date (included)
-   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date);
+   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date) override;
    // get last n rows from table in database (most recent will be first element in vector)
-   std::vector<Bar> read_table(const std::string& tab_name, unsigned n);
-   // get last row from table in database 
-   Bar get_last_row(const std::string& tab_name);
+   std::vector<Bar> read_table(const std::string& tab_name, unsigned n) override;
+   // read table from database into a series of Bars stored by columns
+   BarSeries read_series(const std::string& tab_name);
+   // read table from database into a series of Bars from a given start date (included)
+   BarSeries read_series(const std::string& tab_name, const std::string& start_date);
+   // read table from database into a series of Bars between a given start date and a given end date (included)
+   BarSeries read_series(const std::string& tab_name, const std::string& start_date, const std::string& end_date);
+   // read tables between a given start date and a given end date (included) aligned on the union of their dates,
+   // missing Bars being filled according to policy fill, tables are merged reading at most chunk_size Bars of 
+   // each of them at once
+   Panel read_panel(const std::vector<std::string>& tab_names, const std::string& start_date, const std::string& end_date,
+                    Panel::Fill fill = Panel::FILL_PREVIOUS, std::size_t chunk_size = CHUNK_SIZE);
+   // get last row from table in database into x, return false if the table is empty or missing (or cannot be read)
+   bool get_last_row(const std::string& tab_name, Bar& x) override;
+   // open cursor on full table
+   Cursor open_cursor(const std::string& tab_name, std::size_t chunk_size = CHUNK_SIZE);
+   // open cursor on table between a given start date and a given end date (included)
+   Cursor open_cursor(const std::string& tab_name, const std::string& start_date, const std::string& end_date, std::size_t chunk_size = CHUNK_SIZE);
+   // read full table by chunks calling f(const std::vector<Bar>&) on each of them
+   template <class F>
+   void read_chunks(const std::string& tab_name, F f, std::size_t chunk_size = CHUNK_SIZE);
+   // keep Bars read in an in-memory cache of at most max_bytes, overlapping reads only fetching missing dates
+   void enable_cache(std::size_t max_bytes);
+   // stop caching Bars read and release cache memory
+   void disable_cache();
+   // initialize MySQL driver for the calling thread, to be called before connecting from a new thread
+   static void thread_init();
+   // release MySQL driver resources of the calling thread
+   static void thread_end();
 
 
 private:
    std::unique_ptr<sql::Connection> con;
    std::unique_ptr<sql::Statement> stmt;
-   std::unique_ptr<sql::PreparedStatement> pstmt;
    std::unique_ptr<sql::ResultSet> res;
+   // prepared multi-row INSERT statements indexed by table name, number of rows and whether they ignore duplicates
+   std::map<std::tuple<std::string,int,bool>, std::unique_ptr<sql::PreparedStatement>> insert_stmts;
+   // maximum number of Bars per INSERT statement
+   int batch_size;
+   // cache of Bars read, if enabled
+   std::unique_ptr<BarCache> cache;
+   // pool the connection is borrowed from, null if owned
+   ConnectionPool* pool;
+   // scale of prices of tables already looked up, 0 for prices stored as floats
+   std::map<std::string,int> price_scales;
+
+   // metrics shared by all connections (see Metrics.hpp)
+   struct Stats
+   {
+      Histogram& read_time;
+      Histogram& write_time;
+      Histogram& bulk_load_time;
+      Counter& rows_read;
+      Counter& rows_written;
+      Counter& sql_errors;
+   };
+   // partitioning of tables already looked up along with the first date of their last partition (holding 
+   // all dates above the others), 0 if it is the only one
+   std::map<std::string,std::pair<Partitioning,unsigned>> partitionings;
 
-   // fill vector of Bars with data from table in database
-   void getData(std::vector<Bar>& data);
+   // fill vector of Bars with data from table in database, prices being stored with scale
+   void getData(std::vector<Bar>& data, int scale);
+   // read Bar from current row of result set, columns being read by index in table order
+   static Bar getBar(const sql::ResultSet* rs, int scale);
+   // read Bars from table in database with dates in [start_t,end_t] sorted by date, throw sql::SQLException on failure
+   std::vector<Bar> select(const std::string& tab_name, unsigned start_t, unsigned end_t);
+   // read at most n Bars from table in database with dates in [start_t,end_t] sorted by date
+   std::vector<Bar> select_page(const std::string& tab_name, unsigned start_t, unsigned end_t, std::size_t n);
+   // read last n Bars from table in database (most recent first), throw sql::SQLException on failure
+   std::vector<Bar> select_last(const std::string& tab_name, unsigned n);
+   // fill series of Bars with data from table in database, prices being stored with scale
+   void getData(BarSeries& data, int scale);
+   // get prepared statement inserting nb_rows Bars at once into table, skipping dates already recorded if ignore
+   sql::PreparedStatement* insert_stmt(const std::string& tab_name, int nb_rows, bool ignore);
+   // get CREATE TABLE statement for table of Bars with prices stored with scale (0 for floats), and partitions
+   // for dates from first_date to last_date if partitioned (only the last partition if last_date is 0)
+   static std::string table_definition(const std::string& tab_name, int scale, bool primary_key, 
+                                       Partitioning partitioning = NO_PARTITIONS, unsigned first_date = 0, unsigned last_date = 0);
+   // get metrics shared by all connections
+   static Stats& stats();
+   // look up layout of table (price scale and partitioning) from database
+   void load_layout(const std::string& tab_name);
+   // get partitions of table, name and upper bound (excluded) of each of them, except the last one
+   std::vector<std::pair<std::string,unsigned>> get_partitions(const std::string& tab_name);
+   // split last partition of table so that dates up to last_date have their own partition
+   void add_partitions(const std::string& tab_name, unsigned first_date, unsigned last_date);
+   // get partitions definitions for dates from first_date to last_date followed by the last partition
+   static std::string partition_list(Partitioning partitioning, unsigned first_date, unsigned last_date);
+   // get first date of the partition following the one containing date
+   static unsigned partition_end(Partitioning partitioning, unsigned date);
+   // forget everything known about a table about to be replaced: prepared statements, cached Bars and price scale
+   void forget_table(const std::string& tab_name);
+   // bind Bar parameters to prepared statement for row number row, prices being stored with scale
+   static void bind_bar(sql::PreparedStatement* ps, int row, const Bar& x, int scale);
    // output caught exception details
-   void exception_caught(sql::SQLException &e);
+   static void exception_caught(sql::SQLException &e);
 };
 
 /*-------------------------------------------------------------------------------------------------*/
 
 // parameter constructor
-DataBase::DataBase(const std::string& db_name) 
+DataBase::Cursor::Cursor(sql::Connection* con, const std::string& query, std::size_t chunk_size, int scale) 
+   : chunk_size(std::max<std::size_t>(chunk_size, 1)), scale(scale)
 {
    try {
-      // creating a connection 
-      sql::Driver* driver = get_driver_instance();
-      con.reset(driver->connect(URL,USER,PASSWORD)); 
-      // connecting to database
-      con->setSchema(db_name);  
+      stmt.reset(con->createStatement());
+      // forward only result sets are not buffered client side
+      stmt->setResultSetType(sql::ResultSet::TYPE_FORWARD_ONLY);
+      res.reset(stmt->executeQuery(query));
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read next chunk of at most chunk_size Bars into data (previous content is cleared), 
+// return false once all Bars have been read
+bool DataBase::Cursor::next(std::vector<Bar>& data)
+{
+   data.clear();
+   if (!res) return false;
+
+   ScopedTimer timer(stats().read_time);
+
+   try {
+      data.reserve(chunk_size);
+      while (data.size() < chunk_size && res->next()) {
+         data.push_back(getBar(res.get(), scale));
+      }
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+   stats().rows_read.add(data.size());
+
+   if (data.size() < chunk_size) {
+      // releasing connection as soon as the result set is exhausted
+      res.reset();
+      stmt.reset();
+   }
+
+   return !data.empty();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor
+DataBase::BulkWriter::BulkWriter(DataBase* db, const std::string& tab_name, int scale, Partitioning partitioning)
+   : db(db), tab_name(tab_name), file(nullptr), scale(scale), partitioning(partitioning), first_date(0), last_date(0), count(0)
+{
+   const char* tmp_dir = std::getenv("TMPDIR");
+   std::string pattern = std::string(tmp_dir && *tmp_dir ? tmp_dir : "/tmp") + "/" + tab_name + "_XXXXXX";
+
+   std::vector<char> buf(pattern.begin(), pattern.end());
+   buf.push_back('\0');
+
+   int fd = mkstemp(buf.data());
+   if (fd < 0 || !(file = fdopen(fd, "w"))) {
+      if (fd >= 0) close(fd);
+      throw std::runtime_error("BulkWriter: cannot create temporary file " + pattern + ": " + std::strerror(errno));
+   }
+   path = buf.data();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// move constructor
+DataBase::BulkWriter::BulkWriter(BulkWriter&& other) 
+   : db(other.db), tab_name(std::move(other.tab_name)), path(std::move(other.path)), file(other.file), 
+     scale(other.scale), partitioning(other.partitioning), first_date(other.first_date), last_date(other.last_date), count(other.count)
+{
+   other.file = nullptr;
+   other.path.clear();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// destructor, discard Bars written if not committed
+DataBase::BulkWriter::~BulkWriter()
+{
+   discard();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append Bars from position start in vector, Bars not more recent than the last one written are skipped
+void DataBase::BulkWriter::write(const std::vector<Bar>& data, int start)
+{
+   if (!file) {
+      throw std::runtime_error("BulkWriter: table " + tab_name + " already committed");
+   }
+
+   for (std::size_t i = std::max(start, 0); i < data.size(); ++i) {
+      const Bar& x = data[i];
+      // keeping dates unique for building the key
+      if (count > 0 && x.date <= last_date) continue;
+
+      int n;
+      if (scale) {
+         n = std::fprintf(file, "%u\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%u\n", x.date,
+                          Bar::toFixed(x.openBid, scale), Bar::toFixed(x.openAsk, scale),
+                          Bar::toFixed(x.highBid, scale), Bar::toFixed(x.highAsk, scale),
+                          Bar::toFixed(x.lowBid, scale), Bar::toFixed(x.lowAsk, scale),
+                          Bar::toFixed(x.closeBid, scale), Bar::toFixed(x.closeAsk, scale), x.volume);
+      }
+      else {
+         n = std::fprintf(file, "%u\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%u\n", x.date,
+                          x.openBid, x.openAsk, x.highBid, x.highAsk, x.lowBid, x.lowAsk, x.closeBid, x.closeAsk, x.volume);
+      }
+      if (n < 0) {
+         throw std::runtime_error("BulkWriter: writing to " + path + " failed: " + std::strerror(errno));
+      }
+      if (count == 0) first_date = x.date;
+      last_date = x.date;
+      ++count;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// load Bars written and replace table, return number of Bars loaded, throw std::runtime_error if loading
+// fails (for instance when local_infile is OFF on the server), the table being left unchanged
+std::size_t DataBase::BulkWriter::commit()
+{
+   if (!file) {
+      throw std::runtime_error("BulkWriter: table " + tab_name + " already committed");
+   }
+   if (std::fclose(file) != 0) {
+      file = nullptr;
+      discard();
+      throw std::runtime_error("BulkWriter: writing to " + path + " failed: " + std::strerror(errno));
+   }
+   file = nullptr;
+
+   std::string staging = tab_name + "_staging";
+   std::string old = tab_name + "_old";
+   std::string error;
+
+   ScopedTimer timer(stats().bulk_load_time);
+
+   try {
+      sql::Statement* stmt = db->stmt.get();
+
+      stmt->execute("DROP TABLE IF EXISTS " + staging);
+      stmt->execute(table_definition(staging, scale, false, partitioning, first_date, count ? last_date : 0));
+      // loading without key is a sequential append
+      stmt->execute("LOAD DATA LOCAL INFILE '" + path + "' INTO TABLE " + staging +
+                    " FIELDS TERMINATED BY '\\t' LINES TERMINATED BY '\\n'"
+                    " (date,openBid,openAsk,highBid,highAsk,lowBid,lowAsk,closeBid,closeAsk,volume)");
+      // building the key once from sorted dates
+      stmt->execute("ALTER TABLE " + staging + " ADD PRIMARY KEY(date)");
+
+      // swapping tables atomically if the table already exists
+      db->forget_table(tab_name);
+      std::unique_ptr<sql::ResultSet> rs(stmt->executeQuery("SHOW TABLES LIKE '" + tab_name + "'"));
+      if (rs->next()) {
+         stmt->execute("DROP TABLE IF EXISTS " + old);
+         stmt->execute("RENAME TABLE " + tab_name + " TO " + old + ", " + staging + " TO " + tab_name);
+         stmt->execute("DROP TABLE " + old);
+      }
+      else {
+         stmt->execute("RENAME TABLE " + staging + " TO " + tab_name);
+      }
+      db->price_scales[tab_name] = scale;
+      db->partitionings[tab_name] = std::make_pair(partitioning, count ? partition_end(partitioning, last_date) : 0);
+      stats().rows_written.add(count);
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+      error = e.what();
+      try {
+         db->stmt->execute("DROP TABLE IF EXISTS " + staging);
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+      }
+   }
+
+   discard();
+
+   if (!error.empty()) {
+      throw std::runtime_error("BulkWriter: loading table " + tab_name + " failed: " + error);
+   }
+
+   return count;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// close and remove local file
+void DataBase::BulkWriter::discard()
+{
+   if (file) {
+      std::fclose(file);
+      file = nullptr;
+   }
+   if (!path.empty()) {
+      std::remove(path.c_str());
+      path.clear();
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor
+DataBase::DataBase(const std::string& db_name) : batch_size(BATCH_SIZE), pool(nullptr)
+{
+   try {
+      // creating a connection to database
+      con.reset(ConnectionPool::open(db_name));
       // initializing statement
       stmt.reset(con->createStatement());      
    } catch (sql::SQLException &e) {
@@ -64,22 +440,51 @@ DataBase::DataBase(const std::string& db_name)
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// create or re-initialize a table in database to contain Bars
-void DataBase::create_table(const std::string& tab_name) 
+// parameter constructor, borrow a connection from pool until destruction
+DataBase::DataBase(ConnectionPool& pool) : batch_size(BATCH_SIZE), pool(&pool)
 {
    try {
+      ConnectionPool::Connection c = pool.acquire();
+      con = std::move(c.con);
+      stmt = std::move(c.stmt);
+      insert_stmts = std::move(c.insert_stmts);
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// destructor
+DataBase::~DataBase()
+{
+   // nothing to give back if the connection is owned or could not be acquired
+   if (!pool || !con) return;
+
+   // result set must be released before the connection is lent again
+   res.reset();
+
+   ConnectionPool::Connection c;
+   c.con = std::move(con);
+   c.stmt = std::move(stmt);
+   c.insert_stmts = std::move(insert_stmts);
+   pool->release(std::move(c));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// create or re-initialize a table in database to contain Bars, with prices stored in the given format
+// and partitioned by ranges of dates, a partitioned table starting with a single partition
+void DataBase::create_table(const std::string& tab_name, PriceFormat format, Partitioning partitioning) 
+{
+   int scale = format == FIXED_PRICES ? price_scale(tab_name) : 0;
+
+   try {
+      forget_table(tab_name);
       stmt->execute("DROP TABLE IF EXISTS " + tab_name);
-      stmt->execute("CREATE TABLE " + tab_name + " (date INTEGER UNSIGNED,  "
-                                                 "  openBid FLOAT(8,5),     "
-                                                 "  openAsk FLOAT(8,5),     " 
-                                                 "  highBid FLOAT(8,5),     " 
-                                                 "  highAsk FLOAT(8,5),     " 
-                                                 "  lowBid FLOAT(8,5),      " 
-                                                 "  lowAsk FLOAT(8,5),      " 
-                                                 "  closeBid FLOAT(8,5),    " 
-                                                 "  closeAsk FLOAT(8,5),    "  
-                                                 "  volume INTEGER UNSIGNED,"
-                                                 "  PRIMARY KEY(date))");
+      stmt->execute(table_definition(tab_name, scale, true, partitioning));
+      price_scales[tab_name] = scale;
+      partitionings[tab_name] = std::make_pair(partitioning, 0u);
    } catch (sql::SQLException &e) {
       exception_caught(e);
    }   
@@ -87,39 +492,268 @@ void DataBase::create_table(const std::string& tab_name)
 
 /*-------------------------------------------------------------------------------------------------*/
 
+// get writer (re)building table at once from Bars in the given price format and partitioning, see BulkWriter
+DataBase::BulkWriter DataBase::bulk_writer(const std::string& tab_name, PriceFormat format, Partitioning partitioning)
+{
+   return BulkWriter(this, tab_name, format == FIXED_PRICES ? price_scale(tab_name) : 0, partitioning);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove Bars between a given start date and a given end date (included) before writing them again, 
+// partitions of a partitioned table entirely within the range are emptied at once
+void DataBase::clear_range(const std::string& tab_name, const std::string& start_date, const std::string& end_date)
+{
+   unsigned start_t = string_to_sec(start_date);
+   unsigned end_t = string_to_sec(end_date);
+
+   if (cache) cache->invalidate(tab_name, start_t, end_t);
+
+   try {
+      if (get_partitioning(tab_name) != NO_PARTITIONS) {
+         std::string names;
+         unsigned lower = 0;
+         for (const auto& partition : get_partitions(tab_name)) {
+            if (lower >= start_t && partition.second - 1 <= end_t) {
+               names += (names.empty() ? "" : ",") + partition.first;
+            }
+            lower = partition.second;
+         }
+         if (!names.empty()) {
+            stmt->execute("ALTER TABLE " + tab_name + " TRUNCATE PARTITION " + names);
+         }
+      }
+      // removing remaining Bars, only reading partitions overlapping the range
+      stmt->execute("DELETE FROM " + tab_name + " WHERE date >= " + std::to_string(start_t) + " AND date <= " + std::to_string(end_t));
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
 // write to table in database appending vector of Bars starting from position start in vector
-void DataBase::write_table(const std::string& tab_name, const std::vector<Bar>& data, int start) 
+// Bars are sent by multi-row INSERT statements of batch_size rows within a single transaction
+// NB: INSERT IGNORE also stores out of range or badly converted values as warnings, it is only used when skip_existing
+void DataBase::write_table(const std::string& tab_name, const std::vector<Bar>& data, int start, bool skip_existing) 
 {
+   if (start < 0 || static_cast<std::size_t>(start) >= data.size()) return;
+
+   if (cache) cache->invalidate(tab_name, data[start].date, data.back().date);
+
+   int scale = get_price_scale(tab_name);
+
+   // NB: partitions are added before the transaction as DDL statements commit implicitly
+   if (get_partitioning(tab_name) != NO_PARTITIONS) {
+      add_partitions(tab_name, data[start].date, data.back().date);
+   }
+
+   ScopedTimer timer(stats().write_time);
+
    try {
-      pstmt.reset(con->prepareStatement("INSERT INTO " + tab_name + "(date,     "
-                                                                    " openBid,  "
-                                                                    " openAsk,  "
-                                                                    " highBid,  "
-                                                                    " highAsk,  " 
-                                                                    " lowBid,   "
-                                                                    " lowAsk,   "
-                                                                    " closeBid, "
-                                                                    " closeAsk, "
-                                                                    " volume    "
-                                                                    ") VALUES (?,?,?,?,?,?,?,?,?,?)"));
-      // writing to table
-      for (int i = start; i < data.size(); ++i) {
-         pstmt->setInt(1, data[i].date);
-         pstmt->setDouble(2, data[i].openBid); 
-         pstmt->setDouble(3, data[i].openAsk); 
-         pstmt->setDouble(4, data[i].highBid); 
-         pstmt->setDouble(5, data[i].highAsk); 
-         pstmt->setDouble(6, data[i].lowBid); 
-         pstmt->setDouble(7, data[i].lowAsk); 
-         pstmt->setDouble(8, data[i].closeBid); 
-         pstmt->setDouble(9, data[i].closeAsk); 
-         pstmt->setInt(10, data[i].volume);         
-         pstmt->execute();
+      con->setAutoCommit(false);
+
+      int i = start;
+      int n = data.size();
+
+      // writing full batches
+      while (n - i >= batch_size) {
+         sql::PreparedStatement* ps = insert_stmt(tab_name, batch_size, skip_existing);
+         for (int j = 0; j < batch_size; ++j) {
+            bind_bar(ps, j, data[i + j], scale);
+         }
+         ps->execute();
+         i += batch_size;
+      }
+      // writing remaining Bars by decreasing powers of 2 to keep the number of prepared statements small
+      int nb_rows = 1;
+      while (2 * nb_rows < batch_size) nb_rows *= 2;
+
+      for (; i < n && nb_rows > 0; nb_rows /= 2) {
+         if (n - i < nb_rows) continue;
+         sql::PreparedStatement* ps = insert_stmt(tab_name, nb_rows, skip_existing);
+         for (int j = 0; j < nb_rows; ++j) {
+            bind_bar(ps, j, data[i + j], scale);
+         }
+         ps->execute();
+         i += nb_rows;
       }
 
+      con->commit();
+      con->setAutoCommit(true);
+      stats().rows_written.add(n - start);
+
    } catch (sql::SQLException &e) {
       exception_caught(e);
-   }   
+      try {
+         con->rollback();
+         con->setAutoCommit(true);
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+      }
+   } catch (const std::out_of_range&) {
+      // price not fitting the integer columns, nothing is written
+      try {
+         con->rollback();
+         con->setAutoCommit(true);
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+      }
+      throw;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get scale of prices stored as integers in table (see price_scale in Bar.hpp), 0 if stored as floats
+int DataBase::get_price_scale(const std::string& tab_name)
+{
+   auto it = price_scales.find(tab_name);
+   if (it == price_scales.end()) {
+      load_layout(tab_name);
+      it = price_scales.find(tab_name);
+   }
+
+   return it != price_scales.end() ? it->second : 0;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get partitioning of table
+DataBase::Partitioning DataBase::get_partitioning(const std::string& tab_name)
+{
+   auto it = partitionings.find(tab_name);
+   if (it == partitionings.end()) {
+      load_layout(tab_name);
+      it = partitionings.find(tab_name);
+   }
+
+   return it != partitionings.end() ? it->second.first : NO_PARTITIONS;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// look up layout of table (price scale and partitioning) from database, once per table, 
+// from the table comment written by create_table and the partitions of the table
+void DataBase::load_layout(const std::string& tab_name)
+{
+   int scale = 0;
+   Partitioning partitioning = NO_PARTITIONS;
+   unsigned last_start = 0;
+
+   try {
+      std::unique_ptr<sql::Statement> query(con->createStatement());
+      std::unique_ptr<sql::ResultSet> rs(query->executeQuery("SELECT TABLE_COMMENT FROM information_schema.TABLES "
+                                                             "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '" + tab_name + "'"));
+      if (rs->next()) {
+         std::string comment = rs->getString(1);
+         std::size_t pos = comment.find("price_scale=");
+         if (pos != std::string::npos) scale = std::atoi(comment.c_str() + pos + 12);
+         if (comment.find("partitioning=yearly") != std::string::npos) partitioning = YEARLY_PARTITIONS;
+         if (comment.find("partitioning=monthly") != std::string::npos) partitioning = MONTHLY_PARTITIONS;
+      }
+      if (partitioning != NO_PARTITIONS) {
+         std::vector<std::pair<std::string,unsigned>> partitions = get_partitions(tab_name);
+         if (!partitions.empty()) last_start = partitions.back().second;
+      }
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+      // table not found, not recording its layout
+      return;
+   }
+
+   price_scales[tab_name] = scale;
+   partitionings[tab_name] = std::make_pair(partitioning, last_start);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get partitions of table, name and upper bound (excluded) of each of them, except the last one
+std::vector<std::pair<std::string,unsigned>> DataBase::get_partitions(const std::string& tab_name)
+{
+   std::vector<std::pair<std::string,unsigned>> partitions;
+
+   std::unique_ptr<sql::Statement> query(con->createStatement());
+   std::unique_ptr<sql::ResultSet> rs(query->executeQuery("SELECT PARTITION_NAME, PARTITION_DESCRIPTION FROM information_schema.PARTITIONS "
+                                                          "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '" + tab_name + "' "
+                                                          "AND PARTITION_NAME <> 'pmax' ORDER BY PARTITION_ORDINAL_POSITION"));
+   while (rs->next()) {
+      partitions.emplace_back(rs->getString(1), std::strtoul(std::string(rs->getString(2)).c_str(), nullptr, 10));
+   }
+
+   return partitions;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// split last partition of table so that dates up to last_date have their own partition
+void DataBase::add_partitions(const std::string& tab_name, unsigned first_date, unsigned last_date)
+{
+   std::pair<Partitioning,unsigned>& layout = partitionings[tab_name];
+
+   if (layout.second > last_date) return;
+
+   // the first partition also holds all dates before it
+   unsigned from = layout.second ? layout.second : first_date;
+
+   try {
+      stmt->execute("ALTER TABLE " + tab_name + " REORGANIZE PARTITION pmax INTO (" + partition_list(layout.first, from, last_date) + ")");
+      layout.second = partition_end(layout.first, last_date);
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get partitions definitions for dates from first_date to last_date followed by the last partition
+// partitions are named after the year (pYYYY) or the month (pYYYYMM) they contain
+std::string DataBase::partition_list(Partitioning partitioning, unsigned first_date, unsigned last_date)
+{
+   std::string list;
+
+   if (last_date > 0) {
+      for (unsigned t = first_date; t <= last_date; ) {
+         int year;
+         unsigned month, day, hour, min, sec;
+         sec_to_civil(t, year, month, day, hour, min, sec);
+         // partition named pYYYY or pYYYYMM
+         std::string name = "p" + std::to_string(year);
+         if (partitioning == MONTHLY_PARTITIONS) name += (month < 10 ? "0" : "") + std::to_string(month);
+
+         unsigned end = partition_end(partitioning, t);
+         list += "PARTITION " + name + " VALUES LESS THAN (" + std::to_string(end) + "), ";
+         t = end;
+      }
+   }
+
+   return list + "PARTITION pmax VALUES LESS THAN MAXVALUE";
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get first date of the partition following the one containing date
+unsigned DataBase::partition_end(Partitioning partitioning, unsigned date)
+{
+   int year;
+   unsigned month, day, hour, min, sec;
+   sec_to_civil(date, year, month, day, hour, min, sec);
+
+   if (partitioning == YEARLY_PARTITIONS) {
+      return civil_to_sec(year + 1, 1, 1, 0, 0, 0);
+   }
+
+   return month == 12 ? civil_to_sec(year + 1, 1, 1, 0, 0, 0) : civil_to_sec(year, month + 1, 1, 0, 0, 0);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// set maximum number of Bars sent per multi-row INSERT statement
+void DataBase::set_batch_size(int batch_size)
+{
+   // MySQL limits the number of placeholders in a prepared statement to 65535
+   this->batch_size = std::max(1, std::min(batch_size, 6553));
 }
 
 /*-------------------------------------------------------------------------------------------------*/
@@ -127,12 +761,24 @@ void DataBase::write_table(const std::string& tab_name, const std::vector<Bar>&
 // read full table from database and record the data into a vector of Bars
 std::vector<Bar> DataBase::read_table(const std::string& tab_name) 
 {
+   if (cache) {
+      // NB: nothing is cached for a range that could not be read
+      try {
+         return cache->get(tab_name, 0, BarCache::OPEN, [&](unsigned a, unsigned b) { return select(tab_name, a, b); });
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+         return std::vector<Bar>();
+      }
+   }
+
    std::vector<Bar> data;
 
+   ScopedTimer timer(stats().read_time);
+
    try {
       res.reset(stmt->executeQuery("SELECT * FROM " + tab_name));
 
-      getData(data);
+      getData(data, get_price_scale(tab_name));
 
    } catch (sql::SQLException &e) {
       exception_caught(e);
@@ -146,15 +792,26 @@ std::vector<Bar> DataBase::read_table(const std::string& tab_name)
 // read table from database from a given start date (included)
 std::vector<Bar> DataBase::read_table(const std::string& tab_name, const std::string& start_date)
 {
+   if (cache) {
+      try {
+         return cache->get(tab_name, string_to_sec(start_date), BarCache::OPEN, [&](unsigned a, unsigned b) { return select(tab_name, a, b); });
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+         return std::vector<Bar>();
+      }
+   }
+
    std::vector<Bar> data;
 
    // converting date to seconds since epoch
    std::string start = std::to_string(string_to_sec(start_date));
 
+   ScopedTimer timer(stats().read_time);
+
    try {
       res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " WHERE date >= " + start));
 
-      getData(data);
+      getData(data, get_price_scale(tab_name));
 
    } catch (sql::SQLException &e) {
       exception_caught(e);
@@ -168,16 +825,27 @@ std::vector<Bar> DataBase::read_table(const std::string& tab_name, const std::st
 // read table from database between a given start date and a given end date (included)
 std::vector<Bar> DataBase::read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date)
 {
+   if (cache) {
+      try {
+         return cache->get(tab_name, string_to_sec(start_date), string_to_sec(end_date), [&](unsigned a, unsigned b) { return select(tab_name, a, b); });
+      } catch (sql::SQLException &e) {
+         exception_caught(e);
+         return std::vector<Bar>();
+      }
+   }
+
    std::vector<Bar> data;
 
    // converting dates to seconds since epoch
    std::string start = std::to_string(string_to_sec(start_date));
    std::string end = std::to_string(string_to_sec(end_date));
 
+   ScopedTimer timer(stats().read_time);
+
    try {
       res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " WHERE date >= " + start + " AND date <= " + end));
 
-      getData(data);
+      getData(data, get_price_scale(tab_name));
 
    } catch (sql::SQLException &e) {
       exception_caught(e);
@@ -191,62 +859,524 @@ std::vector<Bar> DataBase::read_table(const std::string& tab_name, const std::st
 // get last n rows from table in database (most recent Bar will be first in vector)
 std::vector<Bar> DataBase::read_table(const std::string& tab_name, unsigned n) 
 {
-   std::vector<Bar> data;
+   try {
+      if (cache) {
+         return cache->get_last(tab_name, n, [&](unsigned a, unsigned b) { return select(tab_name, a, b); },
+                                             [&](unsigned k) { return select_last(tab_name, k); });
+      }
+      return select_last(tab_name, n);
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+
+   return std::vector<Bar>();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table from database into a series of Bars stored by columns
+BarSeries DataBase::read_series(const std::string& tab_name)
+{
+   BarSeries data;
+
+   ScopedTimer timer(stats().read_time);
 
    try {
-      res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " ORDER BY date DESC LIMIT " + std::to_string(n)));
+      res.reset(stmt->executeQuery("SELECT * FROM " + tab_name));
 
-      getData(data);
+      getData(data, get_price_scale(tab_name));
 
    } catch (sql::SQLException &e) {
       exception_caught(e);
    }
 
-   return data;
+   return data; 
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table from database into a series of Bars from a given start date (included)
+BarSeries DataBase::read_series(const std::string& tab_name, const std::string& start_date)
+{
+   BarSeries data;
+
+   // converting date to seconds since epoch
+   std::string start = std::to_string(string_to_sec(start_date));
+
+   ScopedTimer timer(stats().read_time);
+
+   try {
+      res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " WHERE date >= " + start));
+
+      getData(data, get_price_scale(tab_name));
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+
+   return data; 
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// get last row from table in database 
-Bar DataBase::get_last_row(const std::string& tab_name) 
+// read table from database into a series of Bars between a given start date and a given end date (included)
+BarSeries DataBase::read_series(const std::string& tab_name, const std::string& start_date, const std::string& end_date)
 {
+   BarSeries data;
+
+   // converting dates to seconds since epoch
+   std::string start = std::to_string(string_to_sec(start_date));
+   std::string end = std::to_string(string_to_sec(end_date));
+
+   ScopedTimer timer(stats().read_time);
+
+   try {
+      res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " WHERE date >= " + start + " AND date <= " + end));
+
+      getData(data, get_price_scale(tab_name));
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
+   }
+
+   return data; 
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read tables between a given start date and a given end date (included) aligned on the union of their dates,
+// tables are read by pages of chunk_size Bars following their key so that all of them can be streamed 
+// at once over a single connection, pages being merged by date through a heap of the next date of each table
+Panel DataBase::read_panel(const std::vector<std::string>& tab_names, const std::string& start_date, const std::string& end_date,
+                           Panel::Fill fill, std::size_t chunk_size)
+{
+   Panel panel(tab_names, fill);
+
+   chunk_size = std::max<std::size_t>(chunk_size, 1);
+   unsigned start_t = string_to_sec(start_date);
+   unsigned end_t = string_to_sec(end_date);
+   std::size_t k = tab_names.size();
+
+   // current page and position in it for each table
+   std::vector<std::vector<Bar>> pages(k);
+   std::vector<std::size_t> pos(k, 0);
+
+   // reading next page of table i after its current page, return false if there is no more Bars
+   auto next_page = [&](std::size_t i) {
+      bool full = pages[i].size() == chunk_size;
+      unsigned from = pages[i].empty() ? start_t : pages[i].back().date + 1;
+      if (!pages[i].empty() && (!full || pages[i].back().date >= end_t)) {
+         pages[i].clear();
+      }
+      else {
+         pages[i] = select_page(tab_names[i], from, end_t, chunk_size);
+      }
+      pos[i] = 0;
+      return !pages[i].empty();
+   };
+
+   // next date of each table, earliest first
+   typedef std::pair<unsigned,std::size_t> Head;
+   std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+   for (std::size_t i = 0; i < k; ++i) {
+      if (next_page(i)) heads.emplace(pages[i][0].date, i);
+   }
+
+   std::vector<const Bar*> bars(k);
+
+   while (!heads.empty()) {
+      unsigned date = heads.top().first;
+      std::fill(bars.begin(), bars.end(), nullptr);
+
+      // collecting Bars of all tables at this date
+      while (!heads.empty() && heads.top().first == date) {
+         std::size_t i = heads.top().second;
+         heads.pop();
+         bars[i] = &pages[i][pos[i]];
+      }
+      panel.append(date, bars);
+
+      // moving tables collected to their next Bar
+      for (std::size_t i = 0; i < k; ++i) {
+         if (!bars[i]) continue;
+         if (++pos[i] < pages[i].size() || next_page(i)) {
+            heads.emplace(pages[i][pos[i]].date, i);
+         }
+      }
+   }
+
+   return panel;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last row from table in database into x, return false if the table is empty or missing (or cannot be read)
+bool DataBase::get_last_row(const std::string& tab_name, Bar& x) 
+{
+   ScopedTimer timer(stats().read_time);
+
    try {
       res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " ORDER BY date DESC LIMIT 1"));
-      res->next();
-
-      return Bar(res->getInt("date"),
-                 res->getDouble("openBid"),
-                 res->getDouble("openAsk"),
-                 res->getDouble("highBid"),
-                 res->getDouble("highAsk"),
-                 res->getDouble("lowBid"),
-                 res->getDouble("lowAsk"),
-                 res->getDouble("closeBid"),
-                 res->getDouble("closeAsk"),
-                 res->getInt("volume"));
+
+      if (res->next()) {
+         x = getBar(res.get(), get_price_scale(tab_name));
+         return true;
+      }
 
    } catch (sql::SQLException &e) {
       exception_caught(e);
    }
+   return false;
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// fill vector of Bars with data from table in database
-void DataBase::getData(std::vector<Bar>& data)
+// open cursor on full table
+DataBase::Cursor DataBase::open_cursor(const std::string& tab_name, std::size_t chunk_size)
 {
+   return Cursor(con.get(), "SELECT * FROM " + tab_name + " ORDER BY date", chunk_size, get_price_scale(tab_name));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// open cursor on table between a given start date and a given end date (included)
+DataBase::Cursor DataBase::open_cursor(const std::string& tab_name, const std::string& start_date, const std::string& end_date, std::size_t chunk_size)
+{
+   // converting dates to seconds since epoch
+   std::string start = std::to_string(string_to_sec(start_date));
+   std::string end = std::to_string(string_to_sec(end_date));
+
+   return Cursor(con.get(), "SELECT * FROM " + tab_name + " WHERE date >= " + start + " AND date <= " + end + " ORDER BY date", 
+                 chunk_size, get_price_scale(tab_name));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read full table by chunks calling f(const std::vector<Bar>&) on each of them
+template <class F>
+void DataBase::read_chunks(const std::string& tab_name, F f, std::size_t chunk_size)
+{
+   Cursor cursor = open_cursor(tab_name, chunk_size);
+   // buffer reused for every chunk
+   std::vector<Bar> data;
+
+   while (cursor.next(data)) {
+      f(static_cast<const std::vector<Bar>&>(data));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// keep Bars read in an in-memory cache of at most max_bytes, overlapping reads only fetching missing dates
+void DataBase::enable_cache(std::size_t max_bytes)
+{
+   cache.reset(new BarCache(max_bytes));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// stop caching Bars read and release cache memory
+void DataBase::disable_cache()
+{
+   cache.reset();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// initialize MySQL driver for the calling thread, to be called before connecting from a new thread
+void DataBase::thread_init()
+{
+   // NB: the first call to get_driver_instance is not thread safe, 
+   // it has to be done from the main thread before starting workers
+   get_driver_instance()->threadInit();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// release MySQL driver resources of the calling thread
+void DataBase::thread_end()
+{
+   get_driver_instance()->threadEnd();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// default constructor
+DataBase::ThreadScope::ThreadScope()
+{
+   thread_init();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// destructor
+DataBase::ThreadScope::~ThreadScope()
+{
+   thread_end();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// fill vector of Bars with data from table in database, prices being stored with scale
+void DataBase::getData(std::vector<Bar>& data, int scale)
+{
+   data.reserve(data.size() + res->rowsCount());
+   stats().rows_read.add(res->rowsCount());
+
    while (res->next()) {
-      data.emplace_back(res->getInt("date"),
-                        res->getDouble("openBid"),
-                        res->getDouble("openAsk"),
-                        res->getDouble("highBid"),
-                        res->getDouble("highAsk"),
-                        res->getDouble("lowBid"),
-                        res->getDouble("lowAsk"),
-                        res->getDouble("closeBid"),
-                        res->getDouble("closeAsk"),
-                        res->getInt("volume"));
+      data.push_back(getBar(res.get(), scale));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read Bar from current row of result set, columns being read by index in table order
+Bar DataBase::getBar(const sql::ResultSet* rs, int scale)
+{
+   if (scale) {
+      return Bar(rs->getUInt(1),
+                 Bar::fromFixed(rs->getInt(2), scale),
+                 Bar::fromFixed(rs->getInt(3), scale),
+                 Bar::fromFixed(rs->getInt(4), scale),
+                 Bar::fromFixed(rs->getInt(5), scale),
+                 Bar::fromFixed(rs->getInt(6), scale),
+                 Bar::fromFixed(rs->getInt(7), scale),
+                 Bar::fromFixed(rs->getInt(8), scale),
+                 Bar::fromFixed(rs->getInt(9), scale),
+                 rs->getUInt(10));
+   }
+
+   return Bar(rs->getUInt(1),
+              rs->getDouble(2),
+              rs->getDouble(3),
+              rs->getDouble(4),
+              rs->getDouble(5),
+              rs->getDouble(6),
+              rs->getDouble(7),
+              rs->getDouble(8),
+              rs->getDouble(9),
+              rs->getUInt(10));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// fill series of Bars with data from table in database, filling columns directly
+void DataBase::getData(BarSeries& data, int scale)
+{
+   data.reserve(data.size() + res->rowsCount());
+   stats().rows_read.add(res->rowsCount());
+
+   if (scale) {
+      while (res->next()) {
+         data.date.push_back(res->getUInt(1));
+         data.openBid.push_back(Bar::fromFixed(res->getInt(2), scale));
+         data.openAsk.push_back(Bar::fromFixed(res->getInt(3), scale));
+         data.highBid.push_back(Bar::fromFixed(res->getInt(4), scale));
+         data.highAsk.push_back(Bar::fromFixed(res->getInt(5), scale));
+         data.lowBid.push_back(Bar::fromFixed(res->getInt(6), scale));
+         data.lowAsk.push_back(Bar::fromFixed(res->getInt(7), scale));
+         data.closeBid.push_back(Bar::fromFixed(res->getInt(8), scale));
+         data.closeAsk.push_back(Bar::fromFixed(res->getInt(9), scale));
+         data.volume.push_back(res->getUInt(10));
+      }
+      return;
+   }
+
+   while (res->next()) {
+      data.date.push_back(res->getUInt(1));
+      data.openBid.push_back(res->getDouble(2));
+      data.openAsk.push_back(res->getDouble(3));
+      data.highBid.push_back(res->getDouble(4));
+      data.highAsk.push_back(res->getDouble(5));
+      data.lowBid.push_back(res->getDouble(6));
+      data.lowAsk.push_back(res->getDouble(7));
+      data.closeBid.push_back(res->getDouble(8));
+      data.closeAsk.push_back(res->getDouble(9));
+      data.volume.push_back(res->getUInt(10));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read Bars from table in database with dates in [start_t,end_t] sorted by date, throw sql::SQLException on failure
+// so that the cache never takes a failed read for an empty range
+std::vector<Bar> DataBase::select(const std::string& tab_name, unsigned start_t, unsigned end_t)
+{
+   std::vector<Bar> data;
+
+   std::string query = "SELECT * FROM " + tab_name + " WHERE date >= " + std::to_string(start_t);
+   if (end_t != BarCache::OPEN) query += " AND date <= " + std::to_string(end_t);
+   query += " ORDER BY date";
+
+   ScopedTimer timer(stats().read_time);
+
+   res.reset(stmt->executeQuery(query));
+
+   getData(data, get_price_scale(tab_name));
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read at most n Bars from table in database with dates in [start_t,end_t] sorted by date
+std::vector<Bar> DataBase::select_page(const std::string& tab_name, unsigned start_t, unsigned end_t, std::size_t n)
+{
+   std::vector<Bar> data;
+
+   ScopedTimer timer(stats().read_time);
+
+   try {
+      res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " WHERE date >= " + std::to_string(start_t) +
+                                   " AND date <= " + std::to_string(end_t) + " ORDER BY date LIMIT " + std::to_string(n)));
+
+      getData(data, get_price_scale(tab_name));
+
+   } catch (sql::SQLException &e) {
+      exception_caught(e);
    }
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read last n Bars from table in database (most recent first), throw sql::SQLException on failure
+std::vector<Bar> DataBase::select_last(const std::string& tab_name, unsigned n)
+{
+   std::vector<Bar> data;
+
+   ScopedTimer timer(stats().read_time);
+
+   res.reset(stmt->executeQuery("SELECT * FROM " + tab_name + " ORDER BY date DESC LIMIT " + std::to_string(n)));
+
+   getData(data, get_price_scale(tab_name));
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get metrics shared by all connections, looked up once
+DataBase::Stats& DataBase::stats()
+{
+   static Stats s = {metrics().histogram("db_read_seconds"),
+                     metrics().histogram("db_write_seconds"),
+                     metrics().histogram("db_bulk_load_seconds"),
+                     metrics().counter("db_rows_read_total"),
+                     metrics().counter("db_rows_written_total"),
+                     metrics().counter("db_errors_total")};
+   return s;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get prepared statement inserting nb_rows Bars at once into table
+// statements are prepared once and reused for subsequent calls on the same table
+sql::PreparedStatement* DataBase::insert_stmt(const std::string& tab_name, int nb_rows, bool ignore)
+{
+   std::unique_ptr<sql::PreparedStatement>& ps = insert_stmts[std::make_tuple(tab_name, nb_rows, ignore)];
+
+   if (!ps) {
+      std::string query = ignore ? "INSERT IGNORE INTO " : "INSERT INTO ";
+      query += tab_name + "(date,     "
+                          " openBid,  "
+                          " openAsk,  "
+                          " highBid,  "
+                          " highAsk,  " 
+                          " lowBid,   "
+                          " lowAsk,   "
+                          " closeBid, "
+                          " closeAsk, "
+                          " volume    "
+                          ") VALUES ";
+      query.reserve(query.size() + 22 * nb_rows);
+      for (int i = 0; i < nb_rows; ++i) {
+         query += (i == 0 ? "(?,?,?,?,?,?,?,?,?,?)" : ",(?,?,?,?,?,?,?,?,?,?)");
+      }
+      ps.reset(con->prepareStatement(query));
+   }
+
+   return ps.get();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get CREATE TABLE statement for table of Bars with prices stored with scale (0 for floats), and partitions
+// for dates from first_date to last_date if partitioned (only the last partition if last_date is 0)
+// NB: integer prices are stored as pipettes, their scale is recorded in the table comment with the partitioning
+std::string DataBase::table_definition(const std::string& tab_name, int scale, bool primary_key, 
+                                       Partitioning partitioning, unsigned first_date, unsigned last_date)
+{
+   std::string type = scale ? "INTEGER" : "FLOAT(8,5)";
+
+   std::string comment = "price_scale=" + std::to_string(scale);
+   std::string partitions;
+   if (partitioning != NO_PARTITIONS) {
+      comment += partitioning == YEARLY_PARTITIONS ? " partitioning=yearly" : " partitioning=monthly";
+      partitions = " PARTITION BY RANGE (date) (" + partition_list(partitioning, first_date, last_date) + ")";
+   }
+
+   return "CREATE TABLE " + tab_name + " (date INTEGER UNSIGNED,  "
+                                       "  openBid " + type + ",   "
+                                       "  openAsk " + type + ",   " 
+                                       "  highBid " + type + ",   " 
+                                       "  highAsk " + type + ",   " 
+                                       "  lowBid " + type + ",    " 
+                                       "  lowAsk " + type + ",    " 
+                                       "  closeBid " + type + ",  " 
+                                       "  closeAsk " + type + ",  "  
+                                       "  volume INTEGER UNSIGNED" +
+                                       (primary_key ? ", PRIMARY KEY(date))" : ")") +
+                                       " COMMENT='" + comment + "'" + partitions;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// forget everything known about a table about to be replaced: prepared statements, cached Bars and price scale
+void DataBase::forget_table(const std::string& tab_name)
+{
+   for (auto it = insert_stmts.begin(); it != insert_stmts.end();) {
+      if (std::get<0>(it->first) == tab_name) it = insert_stmts.erase(it);
+      else ++it;
+   }
+   if (cache) cache->invalidate(tab_name);
+   price_scales.erase(tab_name);
+   partitionings.erase(tab_name);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// bind Bar parameters to prepared statement for row number row, prices being stored with scale
+void DataBase::bind_bar(sql::PreparedStatement* ps, int row, const Bar& x, int scale)
+{
+   int k = 10 * row;
+
+   ps->setInt(k + 1, x.date);
+
+   if (scale) {
+      ps->setInt(k + 2, Bar::toFixed(x.openBid, scale));
+      ps->setInt(k + 3, Bar::toFixed(x.openAsk, scale));
+      ps->setInt(k + 4, Bar::toFixed(x.highBid, scale));
+      ps->setInt(k + 5, Bar::toFixed(x.highAsk, scale));
+      ps->setInt(k + 6, Bar::toFixed(x.lowBid, scale));
+      ps->setInt(k + 7, Bar::toFixed(x.lowAsk, scale));
+      ps->setInt(k + 8, Bar::toFixed(x.closeBid, scale));
+      ps->setInt(k + 9, Bar::toFixed(x.closeAsk, scale));
+      ps->setInt(k + 10, x.volume);
+      return;
+   }
+
+   ps->setDouble(k + 2, x.openBid); 
+   ps->setDouble(k + 3, x.openAsk); 
+   ps->setDouble(k + 4, x.highBid); 
+   ps->setDouble(k + 5, x.highAsk); 
+   ps->setDouble(k + 6, x.lowBid); 
+   ps->setDouble(k + 7, x.lowAsk); 
+   ps->setDouble(k + 8, x.closeBid); 
+   ps->setDouble(k + 9, x.closeAsk); 
+   ps->setInt(k + 10, x.volume);         
 }
 
 /*-------------------------------------------------------------------------------------------------*/
@@ -254,6 +1384,8 @@ void DataBase::getData(std::vector<Bar>& data)
 // output caught exception details
 void DataBase::exception_caught(sql::SQLException &e) 
 {
+   stats().sql_errors.add();
+
    std::cout << "ERROR: SQLException in " << __FILE__;
    std::cout << " (" << __FUNCTION__ << ") on line " << __LINE__ << "\n";
    std::cout << "ERROR: " << e.what();
@@ -5,6 +5,238 @@ namespace qdb {
 
 //================================================================================================= 
 
+// convert UTC calendar date and time to seconds since epoch without going through libc
+inline time_t civil_to_sec(int year, unsigned month, unsigned day, unsigned hour, unsigned min, unsigned sec)
+{
+   // number of days since 1970-01-01 in the proleptic Gregorian calendar (years starting in March)
+   year -= month <= 2;
+   const int era = (year >= 0 ? year : year - 399) / 400;
+   const unsigned yoe = static_cast<unsigned>(year - era * 400);
+   const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+   const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+   const time_t days = era * 146097LL + static_cast<time_t>(doe) - 719468;
+
+   return days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert seconds since epoch to UTC calendar date and time without going through libc
+inline void sec_to_civil(time_t secs, int& year, unsigned& month, unsigned& day, unsigned& hour, unsigned& min, unsigned& sec)
+{
+   time_t days = secs / 86400;
+   time_t rem = secs % 86400;
+   if (rem < 0) {
+      rem += 86400;
+      --days;
+   }
+   hour = rem / 3600;
+   min = rem % 3600 / 60;
+   sec = rem % 60;
+
+   days += 719468;
+   const int era = static_cast<int>((days >= 0 ? days : days - 146096) / 146097);
+   const unsigned doe = static_cast<unsigned>(days - era * 146097LL);
+   const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+   const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+   const unsigned mp = (5 * doy + 2) / 153;
+   day = doy - (153 * mp + 2) / 5 + 1;
+   month = mp < 10 ? mp + 3 : mp - 9;
+   year = static_cast<int>(yoe) + era * 400 + (month <= 2);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get day of the week (0 for Sunday) from seconds since epoch
+inline unsigned sec_to_wday(time_t secs)
+{
+   time_t days = secs / 86400 - (secs % 86400 < 0);
+   // 1970-01-01 was a Thursday
+   return static_cast<unsigned>(((days + 4) % 7 + 7) % 7);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert string date in format YYYY-mm-dd HH:MM:SS to UTC seconds since epoch without heap allocation
+inline time_t parse_date(const char* p)
+{
+   auto num = [p](int pos, int len) {
+      unsigned x = 0;
+      for (int i = pos; i < pos + len; ++i) x = 10 * x + (p[i] - '0');
+      return x;
+   };
+
+   return civil_to_sec(num(0,4), num(5,2), num(8,2), num(11,2), num(14,2), num(17,2));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write seconds since epoch as string date in format YYYY-mm-dd HH:MM:SS into buf (20 characters at least)
+inline void format_date(time_t secs, char* buf)
+{
+   int year;
+   unsigned month, day, hour, min, sec;
+   sec_to_civil(secs, year, month, day, hour, min, sec);
+
+   auto put = [](char* p, unsigned x, int len) {
+      for (int i = len - 1; i >= 0; --i, x /= 10) p[i] = '0' + x % 10;
+   };
+   put(buf, year, 4);
+   buf[4] = '-';
+   put(buf + 5, month, 2);
+   buf[7] = '-';
+   put(buf + 8, day, 2);
+   buf[10] = ' ';
+   put(buf + 11, hour, 2);
+   buf[13] = ':';
+   put(buf + 14, min, 2);
+   buf[16] = ':';
+   put(buf + 17, sec, 2);
+   buf[19] = '\0';
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// table of US/Eastern daylight saving time transitions in UTC seconds since epoch for years 1970 to 2199
+// following the rules of America/New_York, computed once and then shared read-only between threads
+class DSTTable
+{
+public:
+   static const int FIRST_YEAR = 1970;
+   static const int LAST_YEAR = 2199;
+
+   // get table instance
+   static const DSTTable& get();
+   // get UTC offset in seconds of US/Eastern time at UTC time
+   int utc_offset(time_t utc) const;
+   // get UTC offset in seconds of US/Eastern local time
+   int local_offset(time_t local) const;
+
+private:
+   // DST start and end in UTC seconds since epoch for each year
+   time_t start[LAST_YEAR - FIRST_YEAR + 1];
+   time_t end[LAST_YEAR - FIRST_YEAR + 1];
+
+   // nullary constructor computing the transitions
+   DSTTable();
+   // get nth Sunday (last one if n = 0) of month in seconds since epoch at 00:00
+   static time_t sunday(int year, unsigned month, int n);
+   // get table index of the year containing seconds since epoch
+   static int index(time_t secs);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get table instance
+const DSTTable& DSTTable::get()
+{
+   static const DSTTable table;
+   return table;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// nullary constructor computing the transitions
+DSTTable::DSTTable()
+{
+   for (int y = FIRST_YEAR; y <= LAST_YEAR; ++y) {
+      time_t s, e;
+      if (y >= 2007) {
+         // from second Sunday of March to first Sunday of November
+         s = sunday(y, 3, 2);
+         e = sunday(y, 11, 1);
+      } 
+      else if (y >= 1987) {
+         // from first Sunday of April to last Sunday of October
+         s = sunday(y, 4, 1);
+         e = sunday(y, 10, 0);
+      }
+      else if (y == 1974) {
+         s = civil_to_sec(1974, 1, 6, 0, 0, 0);
+         e = sunday(y, 10, 0);
+      }
+      else if (y == 1975) {
+         s = civil_to_sec(1975, 2, 23, 0, 0, 0);
+         e = sunday(y, 10, 0);
+      }
+      else {
+         // from last Sunday of April to last Sunday of October
+         s = sunday(y, 4, 0);
+         e = sunday(y, 10, 0);
+      }
+      // transitions happen at 02:00 local time, 07:00 UTC when starting and 06:00 UTC when ending
+      start[y - FIRST_YEAR] = s + 7 * 3600;
+      end[y - FIRST_YEAR] = e + 6 * 3600;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get nth Sunday (last one if n = 0) of month in seconds since epoch at 00:00
+time_t DSTTable::sunday(int year, unsigned month, int n)
+{
+   if (n > 0) {
+      time_t first = civil_to_sec(year, month, 1, 0, 0, 0);
+      return first + ((7 - sec_to_wday(first)) % 7 + 7 * (n - 1)) * 86400;
+   }
+   // last day of month
+   time_t last = civil_to_sec(month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1, 0, 0, 0) - 86400;
+   return last - sec_to_wday(last) * 86400;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get table index of the year containing seconds since epoch
+int DSTTable::index(time_t secs)
+{
+   int year;
+   unsigned month, day, hour, min, sec;
+   sec_to_civil(secs, year, month, day, hour, min, sec);
+
+   return std::min(std::max(year, static_cast<int>(FIRST_YEAR)), static_cast<int>(LAST_YEAR)) - FIRST_YEAR;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC offset in seconds of US/Eastern time at UTC time
+int DSTTable::utc_offset(time_t utc) const
+{
+   int i = index(utc);
+
+   return (utc >= start[i] && utc < end[i]) ? -4 * 3600 : -5 * 3600;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC offset in seconds of US/Eastern local time
+// NB: as glibc mktime does, skipped local times when DST starts and repeated local times when DST ends
+// are both considered as standard time (second occurrence for the latter)
+int DSTTable::local_offset(time_t local) const
+{
+   int i = index(local);
+
+   // DST ends at 02:00 daylight time, 01:00 standard time, the hour before being repeated
+   return (local >= start[i] - 4 * 3600 && local < end[i] - 5 * 3600) ? -4 * 3600 : -5 * 3600;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert UTC seconds since epoch to US/Eastern local seconds since epoch
+inline time_t utc_to_est(time_t utc)
+{
+   return utc + DSTTable::get().utc_offset(utc);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert US/Eastern local seconds since epoch to UTC seconds since epoch
+inline time_t est_to_utc(time_t local)
+{
+   return local - DSTTable::get().local_offset(local);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
 // convert string date in format YYYY-mm-dd HH:MM:SS to Oanda format
 inline std::string string_to_oanda(const std::string& date)
 {
@@ -24,13 +256,17 @@ inline std::string oanda_to_string(const std::string& date)
 //convert string date to time structure
 tm string_to_tm(const std::string& date) 
 {
+   int year;
+   unsigned month, day, hour, min, sec;
+   sec_to_civil(parse_date(date.c_str()), year, month, day, hour, min, sec);
+
    tm d = {};
-   d.tm_year = std::stoi(date.substr(0,4).c_str())-1900;
-   d.tm_mon = std::stoi(date.substr(5,2).c_str())-1;
-   d.tm_mday = std::stoi(date.substr(8,2).c_str());
-   d.tm_hour = std::stoi(date.substr(11,2).c_str());
-   d.tm_min = std::stoi(date.substr(14,2).c_str());
-   d.tm_sec = std::stoi(date.substr(17,2).c_str());
+   d.tm_year = year - 1900;
+   d.tm_mon = month - 1;
+   d.tm_mday = day;
+   d.tm_hour = hour;
+   d.tm_min = min;
+   d.tm_sec = sec;
    d.tm_isdst = -1;
 
    return d;
@@ -42,9 +278,7 @@ tm string_to_tm(const std::string& date)
 std::string tm_to_string(tm& d) 
 {
    char buf[20];
-   time_t t = timegm(&d);
-   tm* p = gmtime(&t);
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(civil_to_sec(d.tm_year + 1900, d.tm_mon + 1, d.tm_mday, d.tm_hour, d.tm_min, d.tm_sec), buf);
    return buf;
 }
 
@@ -54,9 +288,7 @@ std::string tm_to_string(tm& d)
 std::string sec_to_string(unsigned secs) 
 {
    char buf[20];
-   time_t t = static_cast<time_t>(secs);
-   tm* p = gmtime(&t);
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(secs, buf);
    return buf;
 }
 
@@ -65,8 +297,7 @@ std::string sec_to_string(unsigned secs)
 // convert string date in format YYYY-mm-dd HH:MM:SS to UTC seconds since epoch
 inline time_t string_to_sec(const std::string& date)
 {
-    tm d = string_to_tm(date);
-    return timegm(&d);
+   return parse_date(date.c_str());
 }
 
 /*-------------------------------------------------------------------------------------------------*/
@@ -75,10 +306,7 @@ inline time_t string_to_sec(const std::string& date)
 std::string get_utc_time()
 {
    char buf[20];
-   time_t t;
-   time(&t); // current local time
-   tm *p = gmtime(&t); // convert local time to UTC time
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(time(nullptr), buf);
    return buf;
 }
 
@@ -88,12 +316,7 @@ std::string get_utc_time()
 std::string get_est_time()
 {
    char buf[20];
-   setenv("TZ","EST5EDT4",1);
-   time_t t;
-   time(&t); //current local time
-   tm *p = localtime(&t);
-   unsetenv("TZ");
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(utc_to_est(time(nullptr)), buf);
    return buf;
 }
 
@@ -103,12 +326,7 @@ std::string get_est_time()
 std::string utc_to_est(const std::string& date)
 {
    char buf[20];
-   tm d = string_to_tm(date);
-   time_t t = timegm(&d);  // seconds to epoch for UTC 
-   setenv("TZ","EST5EDT4",1);
-   tm *p = localtime(&t);  // US/Eastern local time
-   unsetenv("TZ");
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(utc_to_est(parse_date(date.c_str())), buf);
    return buf;
 }
 
@@ -118,34 +336,30 @@ std::string utc_to_est(const std::string& date)
 std::string est_to_utc(const std::string& date)
 {  
    char buf[20];
-   tm d = string_to_tm(date);
-   setenv("TZ","EST5EDT4",1);
-   time_t t = mktime(&d);  // seconds to epoch for US/Eastern
-   unsetenv("TZ");
-   tm* p = gmtime(&t);  // UTC time
-   strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",p);
+   format_date(est_to_utc(parse_date(date.c_str())), buf);
    return buf;
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// checking wether a US/Eastern date is on a week-end, x-mas or new-year
-bool is_day_off(const std::string& dt)
+// checking wether a US/Eastern date in seconds since epoch is on a week-end, x-mas or new-year
+inline bool is_day_off(time_t est)
 {
-   tm d = string_to_tm(dt);
-   time_t t = timegm(&d);      
-   tm* p = gmtime(&t);   
-       
+   int year;
+   unsigned month, day, hour, min, sec;
+   sec_to_civil(est, year, month, day, hour, min, sec);
+   unsigned wday = sec_to_wday(est);
+
    // remove week-ends
-   if ((p->tm_wday==5 && p->tm_hour>=17) || p->tm_wday==6 || (p->tm_wday==0 && p->tm_hour<17)) {
+   if ((wday==5 && hour>=17) || wday==6 || (wday==0 && hour<17)) {
       return true;
    }
    // remove x-mas
-   else if ((p->tm_mon==11 && p->tm_mday==24 && p->tm_hour>=17) || (p->tm_mon==11 && p->tm_mday==25 && p->tm_hour<17)) {
+   else if ((month==12 && day==24 && hour>=17) || (month==12 && day==25 && hour<17)) {
       return true;
    }
    // remove new-year
-   else if ((p->tm_mon==11 && p->tm_mday==31 && p->tm_hour>=17) || (p->tm_mon==00 && p->tm_mday==01 && p->tm_hour<17)) {
+   else if ((month==12 && day==31 && hour>=17) || (month==1 && day==1 && hour<17)) {
       return true;
    } 
    else {
@@ -155,57 +369,158 @@ bool is_day_off(const std::string& dt)
 
 /*-------------------------------------------------------------------------------------------------*/
 
+// checking wether a US/Eastern date is on a week-end, x-mas or new-year
+bool is_day_off(const std::string& dt)
+{
+   return is_day_off(parse_date(dt.c_str()));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// convert Oanda granularity (S5 to S30, M1 to M30, H1 to H12, D, W) into seconds, 0 if not supported 
+// NB: monthly candles (M) have no fixed duration
+inline int granularity_to_sec(const std::string& granularity)
+{
+   if (granularity == "D") {
+      return 86400;
+   }
+   if (granularity == "W") {
+      return 7 * 86400;
+   }
+   if (granularity.size() < 2 || granularity.size() > 3 || (granularity[0] != 'S' && granularity[0] != 'M' && granularity[0] != 'H')) {
+      return 0;
+   }
+   int n = 0;
+   for (std::size_t i = 1; i < granularity.size(); ++i) {
+      if (granularity[i] < '0' || granularity[i] > '9') return 0;
+      n = 10 * n + (granularity[i] - '0');
+   }
+
+   return n * (granularity[0] == 'S' ? 1 : granularity[0] == 'M' ? 60 : 3600);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC date in seconds since epoch of the last 17:00 US/Eastern at or before UTC date utc, 
+// days off as defined by is_day_off all begin and end at 17:00 US/Eastern so that every instant 
+// of a trading day (from 17:00 to 17:00 US/Eastern) is either tradable or not
+inline time_t trading_day_start(time_t utc)
+{
+   time_t est = utc_to_est(utc);
+   // 17:00 of the same local day
+   time_t open = est - ((est % 86400) + 86400) % 86400 + 17 * 3600;
+   if (open > est) open -= 86400;
+
+   return est_to_utc(open);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// call f(day_start, day_end) in date order for each trading day [day_start,day_end) not on days off
+// and overlapping [start_t,end_t), until f returns false
+template <class F>
+void for_each_trading_day(time_t start_t, time_t end_t, F f)
+{
+   time_t t = start_t;
+   while (t < end_t) {
+      time_t day_start = trading_day_start(t);
+      // NB: a trading day lasts 23 or 25 hours when daylight saving time changes
+      time_t day_end = trading_day_start(day_start + 25 * 3600);
+
+      if (!is_day_off(utc_to_est(day_start)) && !f(day_start, day_end)) return;
+
+      t = day_end;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get dates in seconds since epoch splitting [start_t,end_t) into blocks of at most block_size candles
+// of nb_secs seconds (dividing one day), candles being aligned on the start of trading days as Oanda 
+// does and only on trading hours, so that blocks span over days off instead of counting them
+std::vector<time_t> plan_blocks(time_t start_t, time_t end_t, int nb_secs, int block_size)
+{
+   std::vector<time_t> dates(1, start_t);
+
+   // number of candles in current block
+   long long count = 0;
+
+   for_each_trading_day(start_t, end_t, [&](time_t day_start, time_t day_end) -> bool {
+      // index of the first candle of the day at or after start date and after end date
+      long long first = (std::max(day_start, start_t) - day_start + nb_secs - 1) / nb_secs;
+      long long last = (std::min(day_end, end_t) - day_start + nb_secs - 1) / nb_secs;
+      while (count + last - first > block_size) {
+         // starting a new block at the first candle not fitting in the current one
+         first += block_size - count;
+         dates.push_back(day_start + first * nb_secs);
+         count = 0;
+      }
+      count += last - first;
+      return true;
+   });
+
+   if (dates.back() < end_t) {
+      dates.push_back(end_t);
+   }
+
+   return dates;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
 // get a range of dates in Oanda format for downloading historical data by blocks
-// as Oanda is limited to 5000 data per request
-std::vector<std::string> getDates(const std::string& start, const std::string& end, const std::string& granularity)
+// as Oanda is limited to 5000 data per request, blocks are planned on trading hours 
+// so that each of them can be filled up to block_size candles, less BLOCK_HEADROOM percent 
+// left for candles received in periods considered off
+std::vector<std::string> getDates(const std::string& start, const std::string& end, const std::string& granularity, int block_size = BLOCK_SIZE)
 {
    std::vector<std::string> dates;
 
-   int nb_secs;
+   block_size = std::max(block_size, 1);
 
-   // converting granularity into seconds
-   if (granularity.substr(0,1) == "M") {
-      if (granularity.size() == 2) {
-         nb_secs = std::stoi(granularity.substr(1,1)) * 60; 
-      }
-      else if (granularity.size() == 3) {
-         nb_secs = std::stoi(granularity.substr(1,2)) * 60; 
+   // converting start and end date into seconds since epoch
+   time_t start_t = string_to_sec(start);
+   time_t end_t = string_to_sec(end);
+
+   std::vector<time_t> secs;
+
+   if (granularity == "M") {
+      // monthly candles, stepping by block_size calendar months
+      secs.push_back(start_t);
+      int year;
+      unsigned month, day, hour, min, sec;
+      sec_to_civil(start_t, year, month, day, hour, min, sec);
+      for (;;) {
+         int m = month - 1 + block_size;
+         year += m / 12;
+         month = m % 12 + 1;
+         time_t t = civil_to_sec(year, month, 1, 0, 0, 0);
+         if (t >= end_t) break;
+         secs.push_back(t);
       }
+      if (secs.back() < end_t) secs.push_back(end_t);
    }
-   else if (granularity.substr(0,1) == "H") {
-      if (granularity.size() == 2) {
-         nb_secs = std::stoi(granularity.substr(1,1)) * 3600; 
+   else {
+      // converting granularity into seconds
+      int nb_secs = granularity_to_sec(granularity);
+      if (nb_secs == 0) {
+         throw std::invalid_argument("getDates: unsupported granularity " + granularity);
       }
-      else if (granularity.size() == 3) {
-         nb_secs = std::stoi(granularity.substr(1,2)) * 3600; 
+      if (86400 % nb_secs != 0) {
+         // weekly candles, stepping on calendar time which cannot exceed block_size candles
+         secs.push_back(start_t);
+         while (end_t - secs.back() > static_cast<long long>(block_size) * nb_secs) {
+            secs.push_back(secs.back() + static_cast<long long>(block_size) * nb_secs);
+         }
+         if (secs.back() < end_t) secs.push_back(end_t);
+      }
+      else {
+         secs = plan_blocks(start_t, end_t, nb_secs, std::max(block_size - block_size * BLOCK_HEADROOM / 100, 1));
       }
-   } 
-   else if (granularity == "D") {
-      nb_secs = 86400;
    }
 
-   // converting start and end date into seconds since epoch
-   tm d = string_to_tm(start);
-   time_t start_t = timegm(&d);
-   d = string_to_tm(end);
-   time_t end_t = timegm(&d);
-
-   // computing expected number of bars on time interval [start,end]
-   int nb = (end_t - start_t) / nb_secs;
-   // intializing dates
-   dates.push_back(string_to_oanda(start));
-
-   int i = 5000;
-
-   while (i <= nb) {
-      start_t += 5000 * nb_secs;
-      tm* p = gmtime(&start_t);
-      dates.push_back(string_to_oanda(tm_to_string(*p)));
-      i += 5000;
-   }
-   // adding end date if not reached
-   if (start_t < end_t) {
-      dates.push_back(string_to_oanda(tm_to_string(d)));
+   for (time_t t : secs) {
+      dates.push_back(string_to_oanda(sec_to_string(t)));
    }
 
    return dates;
@@ -0,0 +1,495 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef EXPORTER_HPP
+#define EXPORTER_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// exporter streaming tables from database into files for research tools, a table being read by blocks
+// of block_size Bars through a cursor so that memory does not depend on table size, in one of two formats:
+//
+// - columnar (tab_name.qdbc): a header (magic "QDBCOL1\0", price scale and number of columns as uint32),
+//   then blocks of Bars each made of its number of Bars (uint32) followed by the 10 columns in table order,
+//   each column being stored as its size (uint32) and its zlib compressed content, a sequence of varints:
+//   the dates are delta encoded, the prices (integer numbers of 1/scale) and the volumes are delta encoded
+//   and zigzag encoded, deltas starting from 0 in every block so that blocks can be decoded alone,
+//   then the index of the blocks (offset as uint64, number of Bars, first and last dates and a reserved
+//   field as uint32) and a footer (offset of the index and number of blocks as uint64, magic "QDBCEND\0"),
+//   all numbers being little endian
+//
+// - CSV (tab_name.csv): a header line then one line per Bar, dates formatted as YYYY-mm-dd HH:MM:SS and
+//   prices printed with the number of decimals of their scale
+
+class Exporter
+{
+public:
+   // file formats
+   enum Format {COLUMNAR, CSV};
+
+   // parameter constructor, files are written to directory dir (which must exist)
+   Exporter(const std::string& db_name, const std::string& dir, std::size_t block_size = EXPORT_BLOCK_SIZE);
+   // export table to file dir/tab_name.qdbc or dir/tab_name.csv, return number of Bars exported
+   std::size_t exportTab(DataBase& db, const std::string& tab_name, Format format) const;
+   // export table between a given start date and a given end date (included)
+   std::size_t exportTab(DataBase& db, const std::string& tab_name, const std::string& start_date, const std::string& end_date, Format format) const;
+   // export tables, using nb_threads workers each with its own connection from a pool
+   void exportTabs(const std::vector<std::string>& tab_names, Format format, int nb_threads = 1) const;
+   // read columnar file into a series of Bars
+   static BarSeries readColumnar(const std::string& path);
+
+private:
+   // header of columnar files
+   struct Header
+   {
+      char magic[8];
+      std::uint32_t scale;
+      std::uint32_t nb_columns;
+   };
+
+   // entry of the index of blocks of columnar files
+   struct BlockIndex
+   {
+      std::uint64_t offset;
+      std::uint32_t nb_bars;
+      std::uint32_t first_date;
+      std::uint32_t last_date;
+      std::uint32_t reserved;
+   };
+
+   // footer of columnar files
+   struct Footer
+   {
+      std::uint64_t index_offset;
+      std::uint64_t nb_blocks;
+      char magic[8];
+   };
+
+   std::string db_name;
+   std::string dir;
+   std::size_t block_size;
+
+   // write Bars read from cursor to file of table in format, prices being stored with scale
+   std::size_t write(DataBase::Cursor& cursor, const std::string& tab_name, int scale, Format format) const;
+   // append block of Bars in columnar format to out
+   static void encode_block(const std::vector<Bar>& data, int scale, std::string& out);
+   // append block of Bars in CSV to out
+   static void append_csv(const std::vector<Bar>& data, int scale, std::string& out);
+   // append unsigned integer to out as a varint (7 bits per byte, least significant first)
+   static void put_varint(std::string& out, std::uint64_t x);
+   // read varint at p and move p after it
+   static std::uint64_t get_varint(const char*& p, const char* end);
+   // compress buffer with zlib
+   static std::string deflate(const std::string& raw);
+   // decompress buffer compressed with zlib
+   static std::string inflate(const char* p, std::size_t n);
+   // get price as an integer number of 1/scale units over 64 bits, rounded to nearest
+   // NB: unlike Bar::toFixed it does not overflow for indices or metals with a large scale
+   static std::int64_t to_fixed(float price, int scale);
+   // write price given as integer number of 1/scale units at p, return end of written characters
+   static char* format_price(char* p, std::int64_t x, int scale);
+   // write unsigned integer at p, return end of written characters
+   static char* format_uint(char* p, std::uint64_t x);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, files are written to directory dir (which must exist)
+Exporter::Exporter(const std::string& db_name, const std::string& dir, std::size_t block_size)
+   : db_name(db_name), dir(dir), block_size(std::max<std::size_t>(block_size, 1))
+{
+   while (this->dir.size() > 1 && this->dir.back() == '/') this->dir.pop_back();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// export table to file dir/tab_name.qdbc or dir/tab_name.csv, return number of Bars exported
+std::size_t Exporter::exportTab(DataBase& db, const std::string& tab_name, Format format) const
+{
+   // prices stored as floats are exported with the scale of the instrument
+   int scale = db.get_price_scale(tab_name);
+   if (scale == 0) scale = price_scale(tab_name);
+
+   DataBase::Cursor cursor = db.open_cursor(tab_name, block_size);
+
+   return write(cursor, tab_name, scale, format);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// export table between a given start date and a given end date (included)
+std::size_t Exporter::exportTab(DataBase& db, const std::string& tab_name, const std::string& start_date, const std::string& end_date, Format format) const
+{
+   int scale = db.get_price_scale(tab_name);
+   if (scale == 0) scale = price_scale(tab_name);
+
+   DataBase::Cursor cursor = db.open_cursor(tab_name, start_date, end_date, block_size);
+
+   return write(cursor, tab_name, scale, format);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// export tables, using nb_threads workers each with its own connection from a pool
+void Exporter::exportTabs(const std::vector<std::string>& tab_names, Format format, int nb_threads) const
+{
+   if (nb_threads <= 1) {
+      DataBase db(db_name);
+      for (const auto& tab_name : tab_names) {
+         print("exporting table " + tab_name + "...\n");
+         std::size_t n = exportTab(db, tab_name, format);
+         print(std::to_string(n) + " Bar(s) exported from table " + tab_name + "\n");
+      }
+      return;
+   }
+
+   // NB: declared before the pool so that its connections are closed before the driver is released
+   DataBase::ThreadScope scope;
+
+   ConnectionPool pool(db_name, 0, nb_threads);
+
+   for_each_parallel(nb_threads, tab_names.size(), [&](std::size_t i) {
+      // each worker borrows a MySQL connection per table, held by the cursor until the table is exported
+      DataBase db(pool);
+      print("exporting table " + tab_names[i] + "...\n");
+      std::size_t n = exportTab(db, tab_names[i], format);
+      print(std::to_string(n) + " Bar(s) exported from table " + tab_names[i] + "\n");
+   }, DataBase::thread_init, DataBase::thread_end);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read columnar file into a series of Bars
+BarSeries Exporter::readColumnar(const std::string& path)
+{
+   std::ifstream file(path, std::ios::binary);
+   if (!file) {
+      throw std::runtime_error("Exporter: cannot open " + path + ": " + std::strerror(errno));
+   }
+   std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+   Header header;
+   Footer footer;
+   if (content.size() < sizeof(Header) + sizeof(Footer)) {
+      throw std::runtime_error("Exporter: " + path + " is not a columnar file");
+   }
+   std::memcpy(&header, content.data(), sizeof(Header));
+   std::memcpy(&footer, content.data() + content.size() - sizeof(Footer), sizeof(Footer));
+   if (std::memcmp(header.magic, "QDBCOL1", 8) != 0 || std::memcmp(footer.magic, "QDBCEND", 8) != 0 || header.nb_columns != 10 ||
+       footer.index_offset + footer.nb_blocks * sizeof(BlockIndex) + sizeof(Footer) != content.size()) {
+      throw std::runtime_error("Exporter: " + path + " is not a columnar file or is corrupted");
+   }
+
+   // price columns in table order
+   std::vector<float> BarSeries::* prices[8] = {&BarSeries::openBid, &BarSeries::openAsk, &BarSeries::highBid, &BarSeries::highAsk,
+                                                &BarSeries::lowBid, &BarSeries::lowAsk, &BarSeries::closeBid, &BarSeries::closeAsk};
+   BarSeries data;
+
+   for (std::uint64_t b = 0; b < footer.nb_blocks; ++b) {
+      BlockIndex entry;
+      std::memcpy(&entry, content.data() + footer.index_offset + b * sizeof(BlockIndex), sizeof(BlockIndex));
+
+      const char* p = content.data() + entry.offset;
+      const char* end = content.data() + footer.index_offset;
+      std::uint32_t nb_bars;
+      std::memcpy(&nb_bars, p, 4);
+      p += 4;
+      data.reserve(data.size() + nb_bars);
+
+      for (int k = 0; k < 10; ++k) {
+         std::uint32_t size;
+         if (p + 4 > end) throw std::runtime_error("Exporter: " + path + " is corrupted");
+         std::memcpy(&size, p, 4);
+         p += 4;
+         if (p + size > end) throw std::runtime_error("Exporter: " + path + " is corrupted");
+         std::string raw = inflate(p, size);
+         p += size;
+
+         const char* q = raw.data();
+         const char* q_end = q + raw.size();
+         std::int64_t x = 0;
+         for (std::uint32_t i = 0; i < nb_bars; ++i) {
+            std::uint64_t v = get_varint(q, q_end);
+            if (k == 0) {
+               x += static_cast<std::int64_t>(v);
+               data.date.push_back(static_cast<unsigned>(x));
+               continue;
+            }
+            // zigzag decoding
+            x += static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+            if (k < 9) (data.*prices[k - 1]).push_back(static_cast<double>(x) / header.scale);
+            else data.volume.push_back(static_cast<unsigned>(x));
+         }
+      }
+   }
+
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write Bars read from cursor to file of table in format, prices being stored with scale
+// NB: the file is written under a temporary name and renamed once complete, it is removed on failure
+std::size_t Exporter::write(DataBase::Cursor& cursor, const std::string& tab_name, int scale, Format format) const
+{
+   std::string path = dir + "/" + tab_name + (format == COLUMNAR ? ".qdbc" : ".csv");
+   std::string tmp_path = path + ".tmp";
+
+   std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+   if (!file) {
+      throw std::runtime_error("Exporter: cannot open " + tmp_path + ": " + std::strerror(errno));
+   }
+
+   std::size_t count = 0;
+
+   try {
+      std::uint64_t offset = 0;
+      std::vector<BlockIndex> index;
+      // buffer reused for every block
+      std::string buffer;
+
+      if (format == COLUMNAR) {
+         Header header;
+         std::memcpy(header.magic, "QDBCOL1", 8);
+         header.scale = scale;
+         header.nb_columns = 10;
+         file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+         offset = sizeof(Header);
+      }
+      else {
+         buffer = "date,openBid,openAsk,highBid,highAsk,lowBid,lowAsk,closeBid,closeAsk,volume\n";
+         file.write(buffer.data(), buffer.size());
+      }
+
+      std::vector<Bar> data;
+      while (cursor.next(data)) {
+         buffer.clear();
+         if (format == COLUMNAR) {
+            encode_block(data, scale, buffer);
+            BlockIndex entry = {offset, static_cast<std::uint32_t>(data.size()), data.front().date, data.back().date, 0};
+            index.push_back(entry);
+            offset += buffer.size();
+         }
+         else {
+            append_csv(data, scale, buffer);
+         }
+         file.write(buffer.data(), buffer.size());
+         count += data.size();
+      }
+
+      if (format == COLUMNAR) {
+         file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(BlockIndex));
+         Footer footer;
+         footer.index_offset = offset;
+         footer.nb_blocks = index.size();
+         std::memcpy(footer.magic, "QDBCEND", 8);
+         file.write(reinterpret_cast<const char*>(&footer), sizeof(Footer));
+      }
+   } catch (...) {
+      // no partial file is left behind when reading or encoding fails
+      file.close();
+      std::remove(tmp_path.c_str());
+      throw;
+   }
+
+   file.close();
+   if (!file) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Exporter: cannot write " + tmp_path);
+   }
+   if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Exporter: cannot rename " + tmp_path + ": " + std::strerror(errno));
+   }
+
+   return count;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append block of Bars in columnar format to out
+void Exporter::encode_block(const std::vector<Bar>& data, int scale, std::string& out)
+{
+   // price fields in table order
+   float Bar::* prices[8] = {&Bar::openBid, &Bar::openAsk, &Bar::highBid, &Bar::highAsk,
+                             &Bar::lowBid, &Bar::lowAsk, &Bar::closeBid, &Bar::closeAsk};
+
+   std::uint32_t nb_bars = data.size();
+   out.append(reinterpret_cast<const char*>(&nb_bars), 4);
+
+   std::string raw;
+   raw.reserve(5 * data.size());
+
+   for (int k = 0; k < 10; ++k) {
+      raw.clear();
+      std::int64_t prev = 0;
+      for (const auto& x : data) {
+         if (k == 0) {
+            // dates are increasing
+            put_varint(raw, x.date - prev);
+            prev = x.date;
+            continue;
+         }
+         std::int64_t value = k < 9 ? to_fixed(x.*prices[k - 1], scale) : static_cast<std::int64_t>(x.volume);
+         std::int64_t delta = value - prev;
+         // zigzag encoding, small deltas of either sign taking few bytes
+         put_varint(raw, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+         prev = value;
+      }
+      std::string column = deflate(raw);
+      std::uint32_t size = column.size();
+      out.append(reinterpret_cast<const char*>(&size), 4);
+      out.append(column);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append block of Bars in CSV to out, numbers being formatted by hand
+void Exporter::append_csv(const std::vector<Bar>& data, int scale, std::string& out)
+{
+   // longest line: date, 8 prices of up to 22 characters and volume
+   char line[256];
+
+   for (const auto& x : data) {
+      format_date(x.date, line);
+      char* p = line + 19;
+      for (float price : {x.openBid, x.openAsk, x.highBid, x.highAsk, x.lowBid, x.lowAsk, x.closeBid, x.closeAsk}) {
+         *p++ = ',';
+         p = format_price(p, to_fixed(price, scale), scale);
+      }
+      *p++ = ',';
+      p = format_uint(p, x.volume);
+      *p++ = '\n';
+      out.append(line, p - line);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append unsigned integer to out as a varint (7 bits per byte, least significant first)
+void Exporter::put_varint(std::string& out, std::uint64_t x)
+{
+   while (x >= 0x80) {
+      out.push_back(static_cast<char>((x & 0x7f) | 0x80));
+      x >>= 7;
+   }
+   out.push_back(static_cast<char>(x));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read varint at p and move p after it
+std::uint64_t Exporter::get_varint(const char*& p, const char* end)
+{
+   std::uint64_t x = 0;
+
+   for (int shift = 0; shift < 64; shift += 7) {
+      if (p == end) break;
+      std::uint8_t byte = static_cast<std::uint8_t>(*p++);
+      x |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return x;
+   }
+   throw std::runtime_error("Exporter: corrupted column");
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// compress buffer with zlib
+std::string Exporter::deflate(const std::string& raw)
+{
+   std::ostringstream out;
+
+   Poco::DeflatingOutputStream deflater(out, Poco::DeflatingStreamBuf::STREAM_ZLIB);
+   deflater.write(raw.data(), raw.size());
+   deflater.close();
+
+   return out.str();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// decompress buffer compressed with zlib
+std::string Exporter::inflate(const char* p, std::size_t n)
+{
+   std::istringstream in(std::string(p, n));
+   Poco::InflatingInputStream inflater(in, Poco::InflatingStreamBuf::STREAM_ZLIB);
+
+   std::string raw;
+   char buf[16384];
+   while (inflater) {
+      inflater.read(buf, sizeof(buf));
+      raw.append(buf, inflater.gcount());
+   }
+   if (inflater.bad()) {
+      throw std::runtime_error("Exporter: corrupted column");
+   }
+
+   return raw;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get price as an integer number of 1/scale units over 64 bits, rounded to nearest
+std::int64_t Exporter::to_fixed(float price, int scale)
+{
+   double x = static_cast<double>(price) * scale;
+
+   // NB: NaN fails the comparison
+   if (!(std::fabs(x) < 9e18)) {
+      throw std::out_of_range("Exporter: invalid price " + std::to_string(price));
+   }
+
+   return std::llround(x);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write price given as integer number of 1/scale units at p, return end of written characters
+// the number of decimals is the number of digits of scale minus one (5 for 100000)
+char* Exporter::format_price(char* p, std::int64_t x, int scale)
+{
+   if (x < 0) {
+      *p++ = '-';
+      x = -x;
+   }
+   p = format_uint(p, x / scale);
+
+   int nb_decimals = 0;
+   for (int s = scale; s > 1; s /= 10) ++nb_decimals;
+
+   if (nb_decimals > 0) {
+      *p++ = '.';
+      unsigned fraction = x % scale;
+      for (int i = nb_decimals - 1; i >= 0; --i, fraction /= 10) p[i] = '0' + fraction % 10;
+      p += nb_decimals;
+   }
+
+   return p;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write unsigned integer at p, return end of written characters
+char* Exporter::format_uint(char* p, std::uint64_t x)
+{
+   char digits[20];
+   int n = 0;
+   do {
+      digits[n++] = '0' + x % 10;
+      x /= 10;
+   } while (x > 0);
+
+   while (n > 0) *p++ = digits[--n];
+
+   return p;
+}
+
+//=================================================================================================
+
+}
+
+#endif
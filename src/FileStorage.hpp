@@ -0,0 +1,178 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef FILESTORAGE_HPP
+#define FILESTORAGE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// embedded storage engine keeping each table in a local append-only file of fixed width records sorted
+// by date (see BarStore), for research nodes not running a MySQL server: reads are binary searches in
+// the file mapped into memory and writes are appends, without any round trip to a server
+// NB: prices are stored as floats and tables are not partitioned whatever the layout requested, Bars not
+// more recent than the last one of a table are skipped when written (unlike MySQL, no Bar can be inserted
+// before the end of a table)
+
+class FileStorage : public Storage
+{
+public:
+   // parameter constructor, tables being stored in directory dir
+   FileStorage(const std::string& dir);
+   // create or re-initialize a table to contain Bars, the layout requested being ignored
+   void create_table(const std::string& tab_name, PriceFormat format = FLOAT_PRICES, Partitioning partitioning = NO_PARTITIONS) override;
+   // write to table appending new Bars, the table being created if needed
+   // NB: Bars not more recent than the last one of the table are always skipped
+   void write_table(const std::string& tab_name, const std::vector<Bar>& data, int start = 0, bool skip_existing = false) override;
+   // read table and record the data into a vector of Bars
+   std::vector<Bar> read_table(const std::string& tab_name) override;
+   // read table from a given start date (included)
+   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date) override;
+   // read table between a given start date and a given end date (included)
+   std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date) override;
+   // get last n rows from table (most recent will be first element in vector)
+   std::vector<Bar> read_table(const std::string& tab_name, unsigned n) override;
+   // get last row from table into x, return false if the table is empty or missing
+   bool get_last_row(const std::string& tab_name, Bar& x) override;
+
+private:
+   std::string dir;
+   // files of tables already opened
+   std::map<std::string,std::unique_ptr<BarStore>> stores;
+
+   // get file of table, opening it if needed, null if it does not exist and create is false
+   BarStore* get_store(const std::string& tab_name, bool create);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, tables being stored in directory dir
+FileStorage::FileStorage(const std::string& dir) : dir(dir)
+{
+   mkdir(dir.c_str(), 0755);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// create or re-initialize a table to contain Bars, the layout requested being ignored
+void FileStorage::create_table(const std::string& tab_name, PriceFormat format, Partitioning partitioning)
+{
+   // file must be unmapped and closed before being removed
+   stores.erase(tab_name);
+
+   std::string path = BarStore::file_path(dir, tab_name);
+   if (std::remove(path.c_str()) != 0 && errno != ENOENT) {
+      throw std::runtime_error("FileStorage: cannot remove " + path + ": " + std::strerror(errno));
+   }
+
+   get_store(tab_name, true);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write to table appending new Bars, the table being created if needed
+void FileStorage::write_table(const std::string& tab_name, const std::vector<Bar>& data, int start, bool)
+{
+   get_store(tab_name, true)->append(data, std::max(start, 0));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table and record the data into a vector of Bars
+std::vector<Bar> FileStorage::read_table(const std::string& tab_name)
+{
+   BarStore* store = get_store(tab_name, false);
+
+   return store ? store->read_table().toVector() : std::vector<Bar>();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table from a given start date (included)
+std::vector<Bar> FileStorage::read_table(const std::string& tab_name, const std::string& start_date)
+{
+   BarStore* store = get_store(tab_name, false);
+
+   return store ? store->read_table(start_date).toVector() : std::vector<Bar>();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read table between a given start date and a given end date (included)
+std::vector<Bar> FileStorage::read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date)
+{
+   BarStore* store = get_store(tab_name, false);
+
+   return store ? store->read_table(start_date, end_date).toVector() : std::vector<Bar>();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last n rows from table (most recent will be first element in vector)
+std::vector<Bar> FileStorage::read_table(const std::string& tab_name, unsigned n)
+{
+   BarStore* store = get_store(tab_name, false);
+   if (!store) return std::vector<Bar>();
+
+   // NB: the store gives the most recent Bar last
+   BarRange range = store->read_table(n);
+
+   return std::vector<Bar>(std::reverse_iterator<const Bar*>(range.end()), std::reverse_iterator<const Bar*>(range.begin()));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get last row from table into x, return false if the table is empty or missing
+bool FileStorage::get_last_row(const std::string& tab_name, Bar& x)
+{
+   BarStore* store = get_store(tab_name, false);
+   if (store && store->size() > 0) {
+      x = store->get_last_row();
+      return true;
+   }
+   return false;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get file of table, opening it if needed, null if it does not exist and create is false
+BarStore* FileStorage::get_store(const std::string& tab_name, bool create)
+{
+   std::unique_ptr<BarStore>& store = stores[tab_name];
+
+   if (!store) {
+      struct stat st;
+      if (!create && stat(BarStore::file_path(dir, tab_name).c_str(), &st) != 0) {
+         stores.erase(tab_name);
+         return nullptr;
+      }
+      store.reset(new BarStore(dir, tab_name));
+   }
+
+   return store.get();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// open storage engine STORAGE_ENGINE defined in QuotesDB.hpp for database db_name: a MySQL connection,
+// borrowed from pool if not null, or a FileStorage in directory db_name of STORAGE_DIR
+inline std::unique_ptr<Storage> open_storage(const std::string& db_name, ConnectionPool* pool = nullptr)
+{
+   if (STORAGE_ENGINE == "mysql") {
+      return std::unique_ptr<Storage>(pool ? new DataBase(*pool) : new DataBase(db_name));
+   }
+   if (STORAGE_ENGINE == "file") {
+      mkdir(STORAGE_DIR.c_str(), 0755);
+      return std::unique_ptr<Storage>(new FileStorage(STORAGE_DIR + "/" + db_name));
+   }
+
+   throw std::invalid_argument("open_storage: unknown storage engine " + STORAGE_ENGINE);
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef GAPSCANNER_HPP
+#define GAPSCANNER_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// scanner finding holes in tables left by blocks that failed to download: the dates recorded are
+// compared to the grid of Bars expected for the granularity, Bars being aligned on the start of
+// trading days and none being expected on days off (see is_day_off), missing ranges can then be
+// downloaded again alone, Bars already recorded being kept (INSERT IGNORE)
+// NB: Oanda does not return Bars without any tick, short gaps in small granularities are not all
+// errors, only gaps of missing Bars lasting at least min_secs seconds are reported
+
+class GapScanner
+{
+public:
+   // range of missing Bars
+   struct Gap
+   {
+      // dates of the first and last missing Bars in seconds since epoch
+      unsigned start;
+      unsigned end;
+      // number of Bars missing
+      std::size_t nb_bars;
+   };
+
+   // gaps found in table of pair instrument & granularity
+   struct Report
+   {
+      std::string instrument;
+      std::string granularity;
+      std::vector<Gap> gaps;
+   };
+
+   // parameter constructor, tables in database db_name are filled from Oanda through api
+   GapScanner(const OandaAPI& api, const std::string& db_name, int min_secs = GAP_MIN_SECONDS);
+   // find gaps of table for pair instrument & granularity between its first and last Bars
+   std::vector<Gap> scan(DataBase& db, const std::string& instrument, const std::string& granularity) const;
+   // download missing Bars of gaps of table for pair instrument & granularity
+   void fill(DataBase& db, const std::string& instrument, const std::string& granularity, const std::vector<Gap>& gaps) const;
+   // scan all tables for pairs (INSTRUMENTS,GRANULARITIES) defined in QuotesDB.hpp and fill their gaps if fill_gaps
+   // is true, using nb_threads workers each with its own connection from a pool
+   std::vector<Report> scanAll(bool fill_gaps = false, int nb_threads = 1) const;
+
+private:
+   const OandaAPI& api;
+   std::string db_name;
+   int min_secs;
+
+   // scan and fill table for pair instrument & granularity, printing gaps found
+   Report process(DataBase& db, const std::string& instrument, const std::string& granularity, bool fill_gaps) const;
+   // count Bars of nb_secs seconds expected in [start_t,end_t), first and last being set to the dates of
+   // the first and last of them
+   static std::size_t count_slots(time_t start_t, time_t end_t, int nb_secs, time_t& first, time_t& last);
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, tables in database db_name are filled from Oanda through api
+GapScanner::GapScanner(const OandaAPI& api, const std::string& db_name, int min_secs)
+   : api(api), db_name(db_name), min_secs(min_secs) {}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// find gaps of table for pair instrument & granularity between its first and last Bars,
+// the table being streamed by chunks
+std::vector<GapScanner::Gap> GapScanner::scan(DataBase& db, const std::string& instrument, const std::string& granularity) const
+{
+   int nb_secs = granularity_to_sec(granularity);
+   if (nb_secs == 0 || 86400 % nb_secs != 0) {
+      throw std::invalid_argument("GapScanner: unsupported granularity " + granularity);
+   }
+
+   // minimum number of missing Bars of a gap
+   std::size_t min_bars = std::max(min_secs / nb_secs, 1);
+
+   std::vector<Gap> gaps;
+   // date following the last Bar read, 0 before the first one
+   time_t expected = 0;
+
+   db.read_chunks(instrument + "_" + granularity, [&](const std::vector<Bar>& data) {
+      for (const auto& x : data) {
+         if (expected > 0 && x.date > expected) {
+            time_t first = 0, last = 0;
+            std::size_t nb_bars = count_slots(expected, x.date, nb_secs, first, last);
+            if (nb_bars >= min_bars) {
+               Gap gap;
+               gap.start = static_cast<unsigned>(first);
+               gap.end = static_cast<unsigned>(last);
+               gap.nb_bars = nb_bars;
+               gaps.push_back(gap);
+            }
+         }
+         expected = static_cast<time_t>(x.date) + 1;
+      }
+   });
+
+   return gaps;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// download missing Bars of gaps of table for pair instrument & granularity, gaps close to each other
+// being downloaded at once when they fit in a single request
+void GapScanner::fill(DataBase& db, const std::string& instrument, const std::string& granularity, const std::vector<Gap>& gaps) const
+{
+   if (gaps.empty()) return;
+
+   int nb_secs = granularity_to_sec(granularity);
+
+   std::vector<std::pair<std::string,std::string>> ranges;
+   unsigned start = gaps[0].start;
+   unsigned end = gaps[0].end;
+
+   for (std::size_t i = 1; i <= gaps.size(); ++i) {
+      // NB: Bars between two gaps are downloaded again and ignored when written
+      if (i < gaps.size() && (gaps[i].end - start) / nb_secs < BLOCK_SIZE) {
+         end = gaps[i].end;
+         continue;
+      }
+      ranges.emplace_back(sec_to_string(start), sec_to_string(end));
+      if (i < gaps.size()) {
+         start = gaps[i].start;
+         end = gaps[i].end;
+      }
+   }
+
+   api.fillTab(db, instrument, granularity, ranges);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// scan all tables for pairs (INSTRUMENTS,GRANULARITIES) defined in QuotesDB.hpp and fill their gaps if fill_gaps
+// is true, using nb_threads workers each with its own connection from a pool
+std::vector<GapScanner::Report> GapScanner::scanAll(bool fill_gaps, int nb_threads) const
+{
+   std::vector<std::pair<std::string,std::string>> pairs;
+   for (const auto& instrument : INSTRUMENTS) {
+      for (const auto& granularity : GRANULARITIES) {
+         pairs.emplace_back(instrument, granularity);
+      }
+   }
+
+   std::vector<Report> reports(pairs.size());
+
+   if (nb_threads <= 1) {
+      DataBase db(db_name);
+      for (std::size_t i = 0; i < pairs.size(); ++i) {
+         reports[i] = process(db, pairs[i].first, pairs[i].second, fill_gaps);
+      }
+      return reports;
+   }
+
+   // NB: declared before the pool so that its connections are closed before the driver is released
+   DataBase::ThreadScope scope;
+
+   ConnectionPool pool(db_name, 0, nb_threads);
+
+   for_each_parallel(nb_threads, pairs.size(), [&](std::size_t i) {
+      // each worker borrows a MySQL connection per table
+      DataBase db(pool);
+      reports[i] = process(db, pairs[i].first, pairs[i].second, fill_gaps);
+   }, DataBase::thread_init, DataBase::thread_end);
+
+   return reports;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// scan and fill table for pair instrument & granularity, printing gaps found
+GapScanner::Report GapScanner::process(DataBase& db, const std::string& instrument, const std::string& granularity, bool fill_gaps) const
+{
+   Report report;
+   report.instrument = instrument;
+   report.granularity = granularity;
+
+   std::string tab_name = instrument + "_" + granularity;
+   print("scanning table " + tab_name + "...\n");
+
+   report.gaps = scan(db, instrument, granularity);
+
+   std::size_t nb_bars = 0;
+   for (const auto& gap : report.gaps) {
+      print(tab_name + ": " + std::to_string(gap.nb_bars) + " Bar(s) missing from " + sec_to_string(gap.start) +
+            " to " + sec_to_string(gap.end) + "\n");
+      nb_bars += gap.nb_bars;
+   }
+   print(tab_name + ": " + std::to_string(report.gaps.size()) + " gap(s), " + std::to_string(nb_bars) + " Bar(s) missing\n");
+
+   if (fill_gaps) {
+      fill(db, instrument, granularity, report.gaps);
+   }
+
+   return report;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// count Bars of nb_secs seconds (dividing one day) expected in [start_t,end_t), first and last being set to
+// the dates of the first and last of them, Bars being aligned on the start of trading days and none expected 
+// on days off
+std::size_t GapScanner::count_slots(time_t start_t, time_t end_t, int nb_secs, time_t& first, time_t& last)
+{
+   std::size_t count = 0;
+
+   for_each_trading_day(start_t, end_t, [&](time_t day_start, time_t day_end) -> bool {
+      time_t segment_end = std::min(day_end, end_t);
+      // first Bar of the day at or after start date
+      time_t day_first = day_start + (std::max(day_start, start_t) - day_start + nb_secs - 1) / nb_secs * nb_secs;
+      if (day_first < segment_end) {
+         std::size_t n = (segment_end - day_first + nb_secs - 1) / nb_secs;
+         if (count == 0) first = day_first;
+         count += n;
+         last = day_first + (n - 1) * nb_secs;
+      }
+      return true;
+   });
+
+   return count;
+}
+
+//=================================================================================================
+
+}
+
+#endif
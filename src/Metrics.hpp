@@ -0,0 +1,298 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// monotonic counter, updated without lock
+
+class Counter
+{
+public:
+   // default constructor
+   Counter() : value(0) {}
+   // add n to counter
+   void add(std::uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+   // get current value
+   std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+   // set counter back to 0
+   void reset() { value.store(0, std::memory_order_relaxed); }
+
+private:
+   std::atomic<std::uint64_t> value;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// histogram of durations, updated without lock: bucket k counts durations of at most 100us * 2^k,
+// the last bucket counting longer ones
+
+class Histogram
+{
+public:
+   // number of buckets, the last bound being about 1 minute
+   static const int NB_BUCKETS = 21;
+
+   // default constructor
+   Histogram();
+   // record duration in seconds
+   void observe(double seconds);
+   // get upper bound of bucket k in seconds
+   static double bound(int k) { return 1e-4 * static_cast<double>(1u << k); }
+   // get number of durations recorded in bucket k (not cumulative)
+   std::uint64_t getBucket(int k) const { return buckets[k].load(std::memory_order_relaxed); }
+   // get number of durations recorded
+   std::uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+   // get sum of durations recorded in seconds
+   double getSum() const { return 1e-6 * static_cast<double>(sum_us.load(std::memory_order_relaxed)); }
+   // set histogram back to empty
+   void reset();
+
+private:
+   // NB: bucket NB_BUCKETS counts durations above the last bound
+   std::atomic<std::uint64_t> buckets[NB_BUCKETS + 1];
+   std::atomic<std::uint64_t> count;
+   // sum of durations in microseconds
+   std::atomic<std::uint64_t> sum_us;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// registry of counters and histograms identified by name, shared by the whole process (see metrics()):
+// looking up a metric takes a lock so hot paths look it up once and keep the reference, which remains
+// valid for the life of the program, updating it is then a couple of atomic additions
+
+class Metrics
+{
+public:
+   // get counter name, creating it if needed
+   Counter& counter(const std::string& name);
+   // get histogram name, creating it if needed
+   Histogram& histogram(const std::string& name);
+   // get snapshot of all metrics in JSON
+   std::string toJSON() const;
+   // get snapshot of all metrics in Prometheus text exposition format
+   std::string toPrometheus() const;
+   // write snapshot of all metrics to file, in JSON if its name ends with ".json", in Prometheus format otherwise
+   void save(const std::string& file_path) const;
+   // set all metrics back to 0
+   void reset();
+
+private:
+   // NB: metrics are never removed so that references handed out remain valid
+   std::map<std::string,std::unique_ptr<Counter>> counters;
+   std::map<std::string,std::unique_ptr<Histogram>> histograms;
+   mutable std::mutex m;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// timer recording in a histogram the time elapsed between its construction and its destruction
+
+class ScopedTimer
+{
+public:
+   // parameter constructor
+   explicit ScopedTimer(Histogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+   // destructor
+   ~ScopedTimer() { histogram.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()); }
+
+private:
+   Histogram& histogram;
+   std::chrono::steady_clock::time_point start;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// default constructor
+Histogram::Histogram() : count(0), sum_us(0)
+{
+   for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// record duration in seconds
+void Histogram::observe(double seconds)
+{
+   int k = 0;
+   while (k < NB_BUCKETS && seconds > bound(k)) ++k;
+
+   buckets[k].fetch_add(1, std::memory_order_relaxed);
+   count.fetch_add(1, std::memory_order_relaxed);
+   sum_us.fetch_add(static_cast<std::uint64_t>(std::max(seconds, 0.) * 1e6 + 0.5), std::memory_order_relaxed);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// set histogram back to empty
+void Histogram::reset()
+{
+   for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+   count.store(0, std::memory_order_relaxed);
+   sum_us.store(0, std::memory_order_relaxed);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get counter name, creating it if needed
+Counter& Metrics::counter(const std::string& name)
+{
+   std::lock_guard<std::mutex> lock(m);
+
+   std::unique_ptr<Counter>& c = counters[name];
+   if (!c) c.reset(new Counter());
+
+   return *c;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get histogram name, creating it if needed
+Histogram& Metrics::histogram(const std::string& name)
+{
+   std::lock_guard<std::mutex> lock(m);
+
+   std::unique_ptr<Histogram>& h = histograms[name];
+   if (!h) h.reset(new Histogram());
+
+   return *h;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get snapshot of all metrics in JSON, histograms being given with their non cumulative buckets
+// as pairs [upper bound in seconds, count], null standing for the bucket above the last bound
+std::string Metrics::toJSON() const
+{
+   std::lock_guard<std::mutex> lock(m);
+
+   std::ostringstream out;
+   out.precision(10);
+   out << "{\n  \"counters\": {";
+   const char* sep = "\n";
+   for (const auto& elem : counters) {
+      out << sep << "    \"" << elem.first << "\": " << elem.second->get();
+      sep = ",\n";
+   }
+   out << "\n  },\n  \"histograms\": {";
+   sep = "\n";
+   for (const auto& elem : histograms) {
+      const Histogram& h = *elem.second;
+      out << sep << "    \"" << elem.first << "\": {\"count\": " << h.getCount() << ", \"sum\": " << h.getSum() << ", \"buckets\": [";
+      for (int k = 0; k <= Histogram::NB_BUCKETS; ++k) {
+         if (k > 0) out << ", ";
+         out << "[";
+         if (k < Histogram::NB_BUCKETS) out << Histogram::bound(k);
+         else out << "null";
+         out << ", " << h.getBucket(k) << "]";
+      }
+      out << "]}";
+      sep = ",\n";
+   }
+   out << "\n  }\n}\n";
+
+   return out.str();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get snapshot of all metrics in Prometheus text exposition format, metrics names being prefixed by "qdb_"
+std::string Metrics::toPrometheus() const
+{
+   std::lock_guard<std::mutex> lock(m);
+
+   std::ostringstream out;
+   out.precision(10);
+   for (const auto& elem : counters) {
+      out << "# TYPE qdb_" << elem.first << " counter\n";
+      out << "qdb_" << elem.first << " " << elem.second->get() << "\n";
+   }
+   for (const auto& elem : histograms) {
+      const Histogram& h = *elem.second;
+      out << "# TYPE qdb_" << elem.first << " histogram\n";
+      // Prometheus buckets are cumulative
+      std::uint64_t total = 0;
+      for (int k = 0; k < Histogram::NB_BUCKETS; ++k) {
+         total += h.getBucket(k);
+         out << "qdb_" << elem.first << "_bucket{le=\"" << Histogram::bound(k) << "\"} " << total << "\n";
+      }
+      out << "qdb_" << elem.first << "_bucket{le=\"+Inf\"} " << h.getCount() << "\n";
+      out << "qdb_" << elem.first << "_sum " << h.getSum() << "\n";
+      out << "qdb_" << elem.first << "_count " << h.getCount() << "\n";
+   }
+
+   return out.str();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write snapshot of all metrics to file, in JSON if its name ends with ".json", in Prometheus format otherwise
+// NB: the file is written under a temporary name and renamed so that a scraper never reads a partial file
+void Metrics::save(const std::string& file_path) const
+{
+   bool json = file_path.size() >= 5 && file_path.compare(file_path.size() - 5, 5, ".json") == 0;
+   std::string tmp_path = file_path + ".tmp";
+
+   {
+      std::ofstream file(tmp_path, std::ios::trunc);
+      file << (json ? toJSON() : toPrometheus());
+      file.close();
+      if (!file) {
+         std::remove(tmp_path.c_str());
+         throw std::runtime_error("Metrics: cannot write " + tmp_path);
+      }
+   }
+
+   if (std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Metrics: cannot rename " + tmp_path + ": " + std::strerror(errno));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// set all metrics back to 0
+void Metrics::reset()
+{
+   std::lock_guard<std::mutex> lock(m);
+
+   for (auto& elem : counters) elem.second->reset();
+   for (auto& elem : histograms) elem.second->reset();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get metrics of the process
+inline Metrics& metrics()
+{
+   static Metrics registry;
+
+   return registry;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// write snapshot of metrics of the process to METRICS_FILE defined in QuotesDB.hpp if any,
+// a failure only being reported as metrics must not stop an update
+inline void save_metrics()
+{
+   if (METRICS_FILE.empty()) return;
+
+   try {
+      metrics().save(METRICS_FILE);
+   } catch (const std::runtime_error& e) {
+      print(std::string(e.what()) + "\n");
+   }
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -14,32 +14,124 @@ namespace qdb {
 class OandaAPI
 {
 public:
-   // parameter constructor, connect to Oanda server
+   // parameter constructor, connect to Oanda server ("practice" or "live") or to a server 
+   // implementing the same API at a given base URL such as "http://127.0.0.1:8080"
    OandaAPI(const std::string& environment); 
+   // set maximum number of candles requested per block (at most BLOCK_SIZE)
+   void setBlockSize(int block_size);
+   // get maximum number of candles requested per block
+   int getBlockSize() const { return block_size; }
+   // keep completed blocks of historical data received in a local compressed cache in directory dir
+   // and read them from it instead of downloading them again, the cache is shared with worker threads
+   void enableCache(const std::string& dir);
+   // stop using the local cache
+   void disableCache();
    // send request to Oanda server
    std::string request(const std::string& endpoint) const;
-   // get historical data from Oanda
+   // send request to Oanda server passing the response content by chunks to consume(p,n) as it is received
+   void request(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume) const;
+   // get historical data from Oanda, throw once retries of a failed request are exhausted or if the response is
+// truncated or invalid
    void getHistoData(const std::string& instrument, const std::vector<std::string>& parameters, std::vector<Bar>& data) const;
-   // initialize table in database for one pair instrument & granularity
+   // parse historical data returned by Oanda keeping only clean Bars from start date in seconds since epoch,
+   // content being inflated while parsed if compressed with encoding (gzip or deflate), throw if it is truncated or invalid
+   void parseHistoData(const std::string& content, unsigned start_t, std::vector<Bar>& data, const std::string& encoding = "") const;
+   // initialize table in database for one pair instrument & granularity, in the storage engine STORAGE_ENGINE
    void initTab(const std::string& db_name, const std::string& instrument, const std::string& granularity, const std::string& start_date) const;
-   // update table in database for one pair instrument & granularity
+   // initialize table for one pair instrument & granularity using an existing database connection or storage engine
+   void initTab(Storage& db, const std::string& instrument, const std::string& granularity, const std::string& start_date) const;
+   // update table in database for one pair instrument & granularity, in the storage engine STORAGE_ENGINE
    void updateTab(const std::string& db_name, const std::string& instrument, const std::string& granularity) const;
-   // initialize all tables in database
-   void initAllTabs(const std::string& db_name, const std::string& start_date) const;
-   // update all tables in database
-   void updateAllTabs(const std::string& db_name) const;
-   // return all instruments and details available in Oanda
+   // update table for one pair instrument & granularity using an existing database connection or storage engine
+   void updateTab(Storage& db, const std::string& instrument, const std::string& granularity) const;
+   // download again Bars between a given start date and a given end date (included) replacing those in table
+   void reloadTab(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                  const std::string& start_date, const std::string& end_date) const;
+   // download Bars within ranges of dates (start and end dates included) adding those missing from table
+   void fillTab(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                const std::vector<std::pair<std::string,std::string>>& ranges) const;
+   // initialize all tables in database, using nb_threads workers each with its own session and a pool of connections
+   void initAllTabs(const std::string& db_name, const std::string& start_date, int nb_threads = 1) const;
+   // update all tables in database, using nb_threads workers each with its own session and a pool of connections
+   void updateAllTabs(const std::string& db_name, int nb_threads = 1) const;
+   // return all instruments and details available in Oanda, an empty string if the request fails
    std::string getInstruments() const;
+   // build or update tables derived locally from table of granularity as defined in DERIVED_GRANULARITIES
+   void deriveTabs(DataBase& db, const std::string& instrument, const std::string& granularity, bool init) const;
+   // rebuild Bars of tables derived from table of granularity covering dates between a given start date and a given
+   // end date (included)
+   void deriveTabs(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                   const std::string& start_date, const std::string& end_date) const;
 
 private:
-   Poco::Net::HTTPSClientSession *session;    
+   // engine sending requests concurrently over keep-alive sessions, shared with worker threads
+   std::shared_ptr<RequestEngine> engine;
+   std::string environment;
    std::string domain;
+   // maximum number of candles per request
+   int block_size;
+   // local cache of completed blocks of historical data, disabled when null
+   std::shared_ptr<ResponseCache> cache;
+
+   // response content as received, compressed with encoding if not empty
+   struct Response
+   {
+      std::string content;
+      std::string encoding;
+   };
+
+   // metrics shared by all connections (see Metrics.hpp)
+   struct Stats
+   {
+      // time spent by the pipeline stages per block
+      Histogram& download_time;
+      Histogram& parse_time;
+      Histogram& write_time;
+      Counter& cache_hits;
+      Counter& cache_misses;
+      Counter& candles;
+      Counter& accepted;
+      // candles rejected by each cleaning rule, checked in this order
+      Counter& rejected_day_off;
+      Counter& rejected_incomplete;
+      Counter& rejected_duplicate;
+      Counter& rejected_before_start;
+   };
+
+   // numbers of candles of a block counted while parsing it, added to the shared counters once per block
+   struct CandleCounts
+   {
+      std::uint64_t candles = 0;
+      std::uint64_t accepted = 0;
+      std::uint64_t rejected_day_off = 0;
+      std::uint64_t rejected_incomplete = 0;
+      std::uint64_t rejected_duplicate = 0;
+      std::uint64_t rejected_before_start = 0;
+   };
+
+   // get metrics shared by all connections
+   static Stats& stats();
+   // add numbers of candles of a block to the metrics shared by all connections
+   static void addCounts(const CandleCounts& counts);
+   // get all pairs (instrument,granularity) defined in QuotesDB.hpp
+   static std::vector<std::pair<std::string,std::string>> getAllPairs();
+   // add candle to vector of Bars if clean, prev_date being the date of the previous candle, counting it in counts
+   static void addCandle(const Candle& c, unsigned start_t, unsigned& prev_date, std::vector<Bar>& data, CandleCounts& counts);
+   // get partitioning of table of granularity as defined in PARTITIONING
+   static DataBase::Partitioning getPartitioning(const std::string& granularity);
+   // check whether all candles of a block of granularity ending at end_date (Oanda format) are complete
+   static bool isClosed(const std::string& end_date, const std::string& granularity);
+   // get historical data for endpoint from the local cache if the block is closed, from the server otherwise
+   Response download(const std::string& endpoint, const std::string& end_date, const std::string& granularity) const;
+   // download, parse and write blocks of data between dates through a pipeline of concurrent stages
+   void runPipeline(const std::string& instrument, const std::string& granularity, const std::vector<std::string>& dates, 
+                    const std::function<void(const std::vector<Bar>&)>& write) const;
 };
 
 /*-------------------------------------------------------------------------------------------------*/
 
 // parameter constructor, connect to Oanda server
-OandaAPI::OandaAPI(const std::string& environment) 
+OandaAPI::OandaAPI(const std::string& environment) : environment(environment), block_size(BLOCK_SIZE)
 {
    if (environment == "practice") {
       this->domain = "https://api-fxpractice.oanda.com";
@@ -47,22 +139,40 @@ OandaAPI::OandaAPI(const std::string& environment)
    else if (environment == "live") {
       this->domain = "https://api-fxtrade.oanda.com"; 
    }
-
-   try {
-      // context information for a Secure Socket Layer (SSL) client
-      const Poco::Net::Context::Ptr context = new Poco::Net::Context(
-                                                  Poco::Net::Context::CLIENT_USE,"","","",
-                                                  Poco::Net::Context::VERIFY_NONE,9,false,
-                                                  "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH");
-      // implementing the client-side of an HTTP Secure session
-      Poco::URI uri(domain);
-      session = new Poco::Net::HTTPSClientSession(uri.getHost(),uri.getPort(),context);
-      // keeping the connection alive
-      session->setKeepAlive(true);
-   }
-   catch (const Poco::Exception &e) {
-      std::cout << e.displayText() << "\n";
+   else {
+      // any other server given by its base URL, for instance a local server for testing
+      this->domain = environment;
+      while (!domain.empty() && domain.back() == '/') domain.pop_back();
    }
+
+   // sessions are opened on demand by the engine
+   engine = std::make_shared<RequestEngine>(domain);
+   engine->setHeader("Authorization", std::string("Bearer ") + ACCESS_TOKEN);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// set maximum number of candles requested per block (at most BLOCK_SIZE)
+void OandaAPI::setBlockSize(int block_size)
+{
+   this->block_size = std::max(1, std::min(block_size, BLOCK_SIZE));
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// keep completed blocks of historical data received in a local compressed cache in directory dir
+void OandaAPI::enableCache(const std::string& dir)
+{
+   // responses of different servers never sharing entries
+   cache = std::make_shared<ResponseCache>(dir, domain);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// stop using the local cache
+void OandaAPI::disableCache()
+{
+   cache.reset();
 }
 
 /*-------------------------------------------------------------------------------------------------*/
@@ -70,190 +180,491 @@ OandaAPI::OandaAPI(const std::string& environment)
 // send request to Oanda server
 std::string OandaAPI::request(const std::string& endpoint) const 
 {
-   // building URI 
-   Poco::URI uri(domain + endpoint);
-   // preparing path
-   std::string path(uri.getPathAndQuery());
-   if (path.empty()) path = "/";
-   // sending request to receive data from server
-   Poco::Net::HTTPRequest req(Poco::Net::HTTPRequest::HTTP_GET, path, Poco::Net::HTTPMessage::HTTP_1_1);
-   req.set("Authorization", std::string("Bearer ") + ACCESS_TOKEN);
-
-   // sending request to Oanda server
-   session->sendRequest(req);
-
-   Poco::Net::HTTPResponse res;
-   // getting response
-   std::istream& rs = session->receiveResponse(res);
-   // reading response
-   std::istreambuf_iterator<char> eos;
-   std::string content(std::istreambuf_iterator<char>(rs),eos);
+   std::string content;
+
+   request(endpoint, [&content](const char* p, std::size_t n) { content.append(p, n); });
+
    return content;
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// get historical data from Oanda
+// send request to Oanda server passing the response content by chunks to consume(p,n) as it is received
+// NB: transient failures are retried by the engine, an exception is thrown once retries are exhausted
+void OandaAPI::request(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume) const
+{
+   engine->get(endpoint, consume);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get historical data from Oanda, throw once retries of a failed request are exhausted or if the response is
+// truncated or invalid
 void OandaAPI::getHistoData(const std::string& instrument, const std::vector<std::string>& parameters, std::vector<Bar>& data) const 
 {
    std::string params;
    for (const auto& elem : parameters) params += "&" + elem;
 
    std::string endpoint("/v1/candles?instrument=" + instrument + params);
-   std::string content;
 
    // getting start date in seconds since epoch
    unsigned start_t = string_to_sec(oanda_to_string(parameters[0].substr(6,24)));
 
-   try {
-      // getting response content
-      content = request(endpoint);
-   } catch (const Poco::Exception& e) {
-      std::cout << e.displayText() << "\n";
+   // getting end date and granularity of the block if given for looking up the local cache
+   std::string end_date, granularity = "S5";
+   for (const auto& elem : parameters) {
+      if (elem.compare(0, 4, "end=") == 0) end_date = elem.substr(4);
+      else if (elem.compare(0, 12, "granularity=") == 0) granularity = elem.substr(12);
    }
 
-   if (!content.empty()) {
-
-      // parsing content returned
-      Poco::JSON::Parser parser;
-      Poco::Dynamic::Var result = parser.parse(content);
-      Poco::JSON::Object::Ptr obj = result.extract<Poco::JSON::Object::Ptr>();
-      Poco::JSON::Array::Ptr arr = obj->getArray("candles");
-
-      // avoiding duplicate Bars using previous date
-      std::string prev_date;
-
-      // reading response
-      for (int i = 0; i < arr->size(); ++i) {
-         obj = arr->getObject(i);
-         // converting datetime format
-         std::string date = obj->getValue<std::string>("time");
-         // adjusting date format
-         date = date.substr(0,10) + " " + date.substr(11,8);
-         unsigned date_t = string_to_sec(date);
-         // the Bar has to verify the following conditions to be recorded:
-         // Bar is not on a day off 
-         // Bar is complete 
-         // Bar is not a duplicate of the previous one 
-         // Bar date is at or after the chosen starting date for downloading data
-         if (!is_day_off(utc_to_est(date)) && (obj->getValue<bool>("complete") && prev_date != date && date_t >= start_t)) {
-            // adding element
-            data.emplace_back(date_t,
-                              obj->getValue<float>("openBid"),
-                              obj->getValue<float>("openAsk"),
-                              obj->getValue<float>("highBid"),
-                     			obj->getValue<float>("highAsk"),
-                              obj->getValue<float>("lowBid"),
-                              obj->getValue<float>("lowAsk"),
-                              obj->getValue<float>("closeBid"),
-                              obj->getValue<float>("closeAsk"),
-                              obj->getValue<int>("volume"));     
-         }
-         prev_date = date;
+   CandleParser parser;
+   unsigned prev_date = 0;
+   CandleCounts counts;
+
+   if (cache && !end_date.empty() && isClosed(end_date, granularity)) {
+      Response response = download(endpoint, end_date, granularity);
+      RequestEngine::decode(response.content, response.encoding, [&](const char* p, std::size_t n) {
+         parser.feed(p, n, [&](const Candle& c) { addCandle(c, start_t, prev_date, data, counts); });
+      });
+   }
+   else {
+      // decoding response content as it is received
+      request(endpoint, [&](const char* p, std::size_t n) {
+         parser.feed(p, n, [&](const Candle& c) { addCandle(c, start_t, prev_date, data, counts); });
+      });
+   }
+   addCounts(counts);
+
+   if (!parser.done()) {
+      throw std::runtime_error("OandaAPI: truncated or invalid candles response for " + endpoint);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parse historical data returned by Oanda keeping only clean Bars from start date in seconds since epoch,
+// content being inflated while parsed if compressed with encoding (gzip or deflate), throw if it is truncated or invalid
+void OandaAPI::parseHistoData(const std::string& content, unsigned start_t, std::vector<Bar>& data, const std::string& encoding) const
+{
+   CandleParser parser;
+   unsigned prev_date = 0;
+   CandleCounts counts;
+
+   ScopedTimer timer(stats().parse_time);
+
+   // NB: compressed content is inflated by chunks, the whole decompressed content is never held in memory
+   RequestEngine::decode(content, encoding, [&](const char* p, std::size_t n) {
+      parser.feed(p, n, [&](const Candle& c) { addCandle(c, start_t, prev_date, data, counts); });
+   });
+   addCounts(counts);
+
+   if (!parser.done()) {
+      throw std::runtime_error("OandaAPI: truncated or invalid candles response");
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// build or update tables derived locally from table of granularity as defined in DERIVED_GRANULARITIES
+void OandaAPI::deriveTabs(DataBase& db, const std::string& instrument, const std::string& granularity, bool init) const
+{
+   for (const auto& derived : DERIVED_GRANULARITIES) {
+      if (derived.first == granularity) {
+         std::string tab_name = instrument + "_" + derived.second;
+         print("building table " + tab_name + " from " + instrument + "_" + granularity + "...\n");
+         resample_table(db, instrument + "_" + granularity, granularity, tab_name, derived.second, init);
       }
    }
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// initialize table in database for one pair instrument & granularity
+// rebuild Bars of tables derived from table of granularity covering dates between a given start date and a given
+// end date (included), as defined in DERIVED_GRANULARITIES
+void OandaAPI::deriveTabs(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                          const std::string& start_date, const std::string& end_date) const
+{
+   for (const auto& derived : DERIVED_GRANULARITIES) {
+      if (derived.first == granularity) {
+         std::string tab_name = instrument + "_" + derived.second;
+         print("rebuilding table " + tab_name + " from " + start_date + " to " + end_date + "...\n");
+         resample_range(db, instrument + "_" + granularity, granularity, tab_name, derived.second, 
+                        string_to_sec(start_date), string_to_sec(end_date));
+      }
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add candle to vector of Bars if clean, prev_date being the date of the previous candle 
+void OandaAPI::addCandle(const Candle& c, unsigned start_t, unsigned& prev_date, std::vector<Bar>& data, CandleCounts& counts)
+{
+   // the Bar has to verify the following conditions to be recorded:
+   // Bar is not on a day off 
+   // Bar is complete 
+   // Bar is not a duplicate of the previous one 
+   // Bar date is at or after the chosen starting date for downloading data
+   ++counts.candles;
+
+   if (is_day_off(utc_to_est(static_cast<time_t>(c.date)))) {
+      ++counts.rejected_day_off;
+   }
+   else if (!c.complete) {
+      ++counts.rejected_incomplete;
+   }
+   else if (prev_date == c.date) {
+      ++counts.rejected_duplicate;
+   }
+   else if (c.date < start_t) {
+      ++counts.rejected_before_start;
+   }
+   else {
+      ++counts.accepted;
+      // adding element
+      data.emplace_back(c.date,
+                        c.openBid,
+                        c.openAsk,
+                        c.highBid,
+                        c.highAsk,
+                        c.lowBid,
+                        c.lowAsk,
+                        c.closeBid,
+                        c.closeAsk,
+                        c.volume);     
+   }
+   prev_date = c.date;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get partitioning of table of granularity as defined in PARTITIONING
+DataBase::Partitioning OandaAPI::getPartitioning(const std::string& granularity)
+{
+   auto it = PARTITIONING.find(granularity);
+   if (it == PARTITIONING.end()) return DataBase::NO_PARTITIONS;
+
+   if (it->second == "yearly") return DataBase::YEARLY_PARTITIONS;
+   if (it->second == "monthly") return DataBase::MONTHLY_PARTITIONS;
+
+   throw std::invalid_argument("OandaAPI: unknown partitioning " + it->second + " for granularity " + granularity);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get metrics shared by all connections, looked up once
+OandaAPI::Stats& OandaAPI::stats()
+{
+   static Stats s = {metrics().histogram("pipeline_download_seconds"),
+                     metrics().histogram("pipeline_parse_seconds"),
+                     metrics().histogram("pipeline_write_seconds"),
+                     metrics().counter("cache_hits_total"),
+                     metrics().counter("cache_misses_total"),
+                     metrics().counter("candles_received_total"),
+                     metrics().counter("bars_accepted_total"),
+                     metrics().counter("bars_rejected_day_off_total"),
+                     metrics().counter("bars_rejected_incomplete_total"),
+                     metrics().counter("bars_rejected_duplicate_total"),
+                     metrics().counter("bars_rejected_before_start_total")};
+   return s;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add numbers of candles of a block to the metrics shared by all connections
+void OandaAPI::addCounts(const CandleCounts& counts)
+{
+   Stats& s = stats();
+   s.candles.add(counts.candles);
+   s.accepted.add(counts.accepted);
+   s.rejected_day_off.add(counts.rejected_day_off);
+   s.rejected_incomplete.add(counts.rejected_incomplete);
+   s.rejected_duplicate.add(counts.rejected_duplicate);
+   s.rejected_before_start.add(counts.rejected_before_start);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// check whether all candles of a block of granularity ending at end_date (Oanda format) are complete
+bool OandaAPI::isClosed(const std::string& end_date, const std::string& granularity)
+{
+   int nb_secs = granularity_to_sec(granularity);
+   if (nb_secs == 0) return false;
+
+   // the last candle of the block starts before its end date
+   // NB: the end date is URL encoded (2017-03-05T12%3A58%3A30Z)
+   return string_to_sec(oanda_to_string(end_date)) + nb_secs <= time(nullptr);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get historical data for endpoint from the local cache if the block is closed, from the server otherwise,
+// content being kept compressed as received unless it has to be stored in the cache
+OandaAPI::Response OandaAPI::download(const std::string& endpoint, const std::string& end_date, const std::string& granularity) const
+{
+   Response response;
+
+   bool closed = cache && isClosed(end_date, granularity);
+
+   if (closed && cache->get(endpoint, response.content)) {
+      stats().cache_hits.add();
+      return response;
+   }
+   if (cache) stats().cache_misses.add();
+
+   if (!closed) {
+      response.content = engine->getEncoded(endpoint, response.encoding);
+      return response;
+   }
+
+   std::string& content = response.content;
+   content = request(endpoint);
+
+   // NB: only responses parsed up to the end of their candles array are kept, error messages and
+   // truncated or malformed responses being downloaded again next time
+   try {
+      CandleParser parser;
+      parser.feed(content.data(), content.size(), [](const Candle&) {});
+      if (parser.done()) cache->put(endpoint, content);
+   } catch (const std::runtime_error& e) {
+      // failing to store a block only means downloading it again next time
+      print(std::string(e.what()) + "\n");
+   }
+
+   return response;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// initialize table in database for one pair instrument & granularity, in the storage engine STORAGE_ENGINE
 void OandaAPI::initTab(const std::string& db_name, const std::string& instrument, const std::string& granularity, const std::string& start_date) const
+{
+   // connecting to database table
+   std::unique_ptr<Storage> db = open_storage(db_name);
+
+   initTab(*db, instrument, granularity, start_date);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// initialize table for one pair instrument & granularity using an existing database connection or storage engine,
+// bulk loading and derived tables being only available with MySQL
+void OandaAPI::initTab(Storage& db, const std::string& instrument, const std::string& granularity, const std::string& start_date) const
 {
    // getting table name to write to
    std::string tab_name = instrument + "_" + granularity;
-   // connecting to database table
-   DataBase db(db_name);
-   // creating table
-   db.create_table(tab_name);
+   Storage::PriceFormat format = FIXED_POINT_PRICES ? Storage::FIXED_PRICES : Storage::FLOAT_PRICES;
    // getting block dates for data download, start date included, end date excluded
-   std::vector<std::string> dates = getDates(start_date, get_utc_time(), granularity);
-   // container of Bars
-   std::vector<Bar> data;
-
-   // downloading data
-   for (int i = 0; i < dates.size() - 1; ++i) {
-      std::cout << "downloading " + instrument + " " + granularity + " data from " << oanda_to_string(dates[i]);
-      std::cout << " to " << oanda_to_string(dates[i + 1]) << "...\n";
-      
-      getHistoData(instrument, {"start="+dates[i],"end="+dates[i+1],"candleFormat=bidask","granularity="+ granularity}, data);
-
-      std::cout << "writing to table " + tab_name + "...\n";
-      db.write_table(tab_name, data);
-      // clearing vector
-      data.clear();
+   std::vector<std::string> dates = getDates(start_date, get_utc_time(), granularity, block_size);
+   // MySQL connection, null with another storage engine
+   DataBase* mysql = dynamic_cast<DataBase*>(&db);
+
+   if (BULK_LOAD && mysql) {
+      // staging Bars in a local file, the table being replaced once all of them are loaded
+      DataBase::BulkWriter writer = mysql->bulk_writer(tab_name, format, getPartitioning(granularity));
+
+      runPipeline(instrument, granularity, dates, [&](const std::vector<Bar>& data) {
+         writer.write(data);
+      });
+
+      print("loading table " + tab_name + "...\n");
+      writer.commit();
    }
-   std::cout << "all done for " + instrument + " " + granularity << "\n";
+   else {
+      // creating table
+      db.create_table(tab_name, format, getPartitioning(granularity));
+
+      // downloading data while writing previous blocks
+      runPipeline(instrument, granularity, dates, [&](const std::vector<Bar>& data) {
+         print("writing to table " + tab_name + "...\n");
+         db.write_table(tab_name, data);
+      });
+   }
+
+   if (mysql) deriveTabs(*mysql, instrument, granularity, true);
+
+   print("all done for " + instrument + " " + granularity + "\n");
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// update database for one pair instrument & granularity
+// update database for one pair instrument & granularity, in the storage engine STORAGE_ENGINE
 void OandaAPI::updateTab(const std::string& db_name, const std::string& instrument, const std::string& granularity) const
+{
+   // connecting to database
+   std::unique_ptr<Storage> db = open_storage(db_name);
+
+   updateTab(*db, instrument, granularity);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// update table for one pair instrument & granularity using an existing database connection or storage engine,
+// derived tables being only available with MySQL
+void OandaAPI::updateTab(Storage& db, const std::string& instrument, const std::string& granularity) const
 {
    // getting table name to write to
    std::string tab_name = instrument + "_" + granularity;
-   // connecting to database
-   DataBase db(db_name);
    // getting last recorded Bar in table
-   Bar x = db.get_last_row(tab_name);
+   Bar x;
+   if (!db.get_last_row(tab_name, x)) {
+      // NB: there is no start date to download an empty table from, it has to be initialized by initTab
+      print("table " + tab_name + " is empty or missing, it has to be initialized first\n");
+      return;
+   }
    // getting block dates for data download
-   std::vector<std::string> dates = getDates(sec_to_string(x.date), get_utc_time(), granularity);
-   // container of Bars
-   std::vector<Bar> data;
+   std::vector<std::string> dates = getDates(sec_to_string(x.date), get_utc_time(), granularity, block_size);
 
    // NB: As we start downloading from the last recorded Bar date 
    // we will get a duplicate Bar, we will skip it when writing to the table
 
-   // downloading data
-   for (int i = 0; i < dates.size() - 1; ++i) {
-      std::cout << "downloading " + instrument + " " + granularity + " data from " << oanda_to_string(dates[i]);
-      std::cout << " to " << oanda_to_string(dates[i + 1]) << "...\n";
-      
-      getHistoData(instrument, {"start="+dates[i],"end="+dates[i+1],"candleFormat=bidask","granularity="+ granularity}, data);
-
-      std::cout << "writing to table " + tab_name + "...\n";
+   // downloading data while writing previous blocks
+   runPipeline(instrument, granularity, dates, [&](const std::vector<Bar>& data) {
+      print("writing to table " + tab_name + "...\n");
 
       if (data.size() > 1) {
          // skipping first Bar for avoiding duplicate
          db.write_table(tab_name, data, 1);
       }
-      // clearing vector
-      data.clear();
+   });
+
+   DataBase* mysql = dynamic_cast<DataBase*>(&db);
+   if (mysql) deriveTabs(*mysql, instrument, granularity, false);
+
+   print("all done for " + instrument + " " + granularity + "\n");
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// download again Bars between a given start date and a given end date (included) replacing those in table,
+// only the partitions of the range being rewritten in a partitioned table and the Bars of derived tables
+// covering the range being rebuilt
+// NB: Bars of the range are kept in memory until all of them are downloaded, the table being left untouched
+// if a block fails
+void OandaAPI::reloadTab(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                         const std::string& start_date, const std::string& end_date) const
+{
+   // getting table name to write to
+   std::string tab_name = instrument + "_" + granularity;
+   // getting block dates for data download, end date included
+   std::vector<std::string> dates = getDates(start_date, sec_to_string(string_to_sec(end_date) + 1), granularity, block_size);
+
+   // downloading all blocks before touching the table
+   std::vector<Bar> bars;
+   runPipeline(instrument, granularity, dates, [&](const std::vector<Bar>& data) {
+      bars.insert(bars.end(), data.begin(), data.end());
+   });
+
+   print("clearing table " + tab_name + " from " + start_date + " to " + end_date + "...\n");
+   db.clear_range(tab_name, start_date, end_date);
+
+   print("writing to table " + tab_name + "...\n");
+   db.write_table(tab_name, bars);
+
+   deriveTabs(db, instrument, granularity, start_date, end_date);
+
+   print("all done for " + instrument + " " + granularity + "\n");
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// download Bars within ranges of dates (start and end dates included) adding those missing from table,
+// Bars already recorded being kept, then rebuild derived tables
+void OandaAPI::fillTab(DataBase& db, const std::string& instrument, const std::string& granularity, 
+                       const std::vector<std::pair<std::string,std::string>>& ranges) const
+{
+   // getting table name to write to
+   std::string tab_name = instrument + "_" + granularity;
+
+   for (const auto& range : ranges) {
+      // getting block dates for data download, end date included
+      std::vector<std::string> dates = getDates(range.first, sec_to_string(string_to_sec(range.second) + 1), granularity, block_size);
+
+      // NB: Bars already recorded are skipped (INSERT IGNORE)
+      runPipeline(instrument, granularity, dates, [&](const std::vector<Bar>& data) {
+         print("writing to table " + tab_name + "...\n");
+         db.write_table(tab_name, data, 0, true);
+      });
+
+      // rebuilding only derived Bars covering the range
+      deriveTabs(db, instrument, granularity, range.first, range.second);
    }
-   std::cout << "all done for " + instrument + " " + granularity << "\n";
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// initialize all tables in database
-void OandaAPI::initAllTabs(const std::string& db_name, const std::string& start_date) const
+// initialize all tables in database, using nb_threads workers each with its own session and a pool of connections
+void OandaAPI::initAllTabs(const std::string& db_name, const std::string& start_date, int nb_threads) const
 {
-   for (const auto& instrument : INSTRUMENTS) {
-      for (const auto& granularity : GRANULARITIES) {
-         std::cout << "\n" << "-----------------------------------------------------------------------------" << "\n\n";
-         initTab(db_name, instrument, granularity, start_date);
-      }      
+   std::vector<std::pair<std::string,std::string>> pairs = getAllPairs();
+
+   if (nb_threads <= 1) {
+      std::unique_ptr<Storage> db = open_storage(db_name);
+      for (const auto& pair : pairs) {
+         print("\n-----------------------------------------------------------------------------\n\n");
+         initTab(*db, pair.first, pair.second, start_date);
+      }
+      print("\n");
+      save_metrics();
+      return;
    }
-   std::cout << "\n";
+
+   // NB: declared before the pool so that its connections are closed before the driver is released
+   DataBase::ThreadScope scope;
+
+   // connections shared by workers, health-checked each time a worker borrows one for a new table
+   // NB: other storage engines open their tables in each worker
+   std::unique_ptr<ConnectionPool> pool;
+   if (STORAGE_ENGINE == "mysql") pool.reset(new ConnectionPool(db_name, 0, nb_threads));
+
+   // sessions, request rate limit and response cache are shared by all workers
+   for_each_parallel(nb_threads, pairs.size(), [&](std::size_t i) {
+      // each worker borrows a MySQL connection per table, or opens tables of another storage engine
+      std::unique_ptr<Storage> db = open_storage(db_name, pool.get());
+      initTab(*db, pairs[i].first, pairs[i].second, start_date);
+   }, DataBase::thread_init, DataBase::thread_end);
+
+   save_metrics();
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// update all tables in database
-void OandaAPI::updateAllTabs(const std::string& db_name) const
+// update all tables in database, using nb_threads workers each with its own session and a pool of connections
+void OandaAPI::updateAllTabs(const std::string& db_name, int nb_threads) const
 {
-   for (const auto& instrument : INSTRUMENTS) {
-      for (const auto& granularity : GRANULARITIES) {
-         std::cout << "\n" << "-----------------------------------------------------------------------------" << "\n\n";
-         updateTab(db_name, instrument, granularity);
-      }      
+   std::vector<std::pair<std::string,std::string>> pairs = getAllPairs();
+
+   if (nb_threads <= 1) {
+      std::unique_ptr<Storage> db = open_storage(db_name);
+      for (const auto& pair : pairs) {
+         print("\n-----------------------------------------------------------------------------\n\n");
+         updateTab(*db, pair.first, pair.second);
+      }
+      print("\n");
+      save_metrics();
+      return;
    }
-   std::cout << "\n";
+
+   // NB: declared before the pool so that its connections are closed before the driver is released
+   DataBase::ThreadScope scope;
+
+   // connections shared by workers, health-checked each time a worker borrows one for a new table
+   // NB: other storage engines open their tables in each worker
+   std::unique_ptr<ConnectionPool> pool;
+   if (STORAGE_ENGINE == "mysql") pool.reset(new ConnectionPool(db_name, 0, nb_threads));
+
+   // sessions, request rate limit and response cache are shared by all workers
+   for_each_parallel(nb_threads, pairs.size(), [&](std::size_t i) {
+      // each worker borrows a MySQL connection per table, or opens tables of another storage engine
+      std::unique_ptr<Storage> db = open_storage(db_name, pool.get());
+      updateTab(*db, pairs[i].first, pairs[i].second);
+   }, DataBase::thread_init, DataBase::thread_end);
+
+   save_metrics();
 }
 
 /*-------------------------------------------------------------------------------------------------*/
 
-// return all instruments and details available in Oanda
+// return all instruments and details available in Oanda, an empty string if the request fails
 std::string OandaAPI::getInstruments() const
 {
    std::string endpoint("/v1/instruments?accountId=" + ACCOUNT_ID);
@@ -262,7 +673,119 @@ std::string OandaAPI::getInstruments() const
       return request(endpoint);
    } catch (const Poco::Exception& e) {
       std::cout << e.displayText() << "\n";
+   } catch (const std::exception& e) {
+      // request failed once its retries were exhausted
+      std::cout << e.what() << "\n";
    }
+   return "";
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// download, parse and write blocks of data between dates through a pipeline of concurrent stages:
+// block i+1 is downloaded while block i is parsed and cleaned and block i-1 is written by the calling thread,
+// at most PIPELINE_DEPTH blocks can wait between two stages to keep memory bounded
+void OandaAPI::runPipeline(const std::string& instrument, const std::string& granularity, const std::vector<std::string>& dates,
+                           const std::function<void(const std::vector<Bar>&)>& write) const
+{
+   // responses waiting to be parsed as received, still compressed, along with their start date in seconds since epoch
+   BoundedQueue<std::pair<unsigned,Response>> contents(PIPELINE_DEPTH);
+   // clean Bars waiting to be written
+   BoundedQueue<std::vector<Bar>> blocks(PIPELINE_DEPTH);
+
+   std::exception_ptr error;
+   std::mutex error_mutex;
+
+   // stopping every stage after the first error
+   auto abort = [&]() {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) error = std::current_exception();
+      contents.close();
+      blocks.close();
+   };
+
+   // downloading stage, as many blocks as the engine has sessions being requested concurrently,
+   // blocks are passed on in date order
+   std::thread downloader([&]() {
+      try {
+         // blocks being downloaded along with their start date in seconds since epoch
+         std::deque<std::pair<unsigned,std::future<Response>>> pending;
+         int nb_blocks = static_cast<int>(dates.size()) - 1;
+         int i = 0;
+         while (i < nb_blocks || !pending.empty()) {
+            for (; i < nb_blocks && pending.size() < static_cast<std::size_t>(engine->getSessions()); ++i) {
+               print("downloading " + instrument + " " + granularity + " data from " + oanda_to_string(dates[i]) +
+                     " to " + oanda_to_string(dates[i + 1]) + "...\n");
+
+               std::string endpoint("/v1/candles?instrument=" + instrument + "&start=" + dates[i] + "&end=" + dates[i+1] +
+                                    "&candleFormat=bidask&granularity=" + granularity);
+               std::string end_date = dates[i + 1];
+               unsigned start_t = string_to_sec(oanda_to_string(dates[i]));
+               pending.emplace_back(start_t, std::async(std::launch::async, [this, endpoint, end_date, granularity]() {
+                  ScopedTimer timer(stats().download_time);
+                  return download(endpoint, end_date, granularity);
+               }));
+            }
+            // NB: a block failing after all retries stops the pipeline, previous blocks being written
+            Response content = pending.front().second.get();
+            unsigned start_t = pending.front().first;
+            pending.pop_front();
+            if (!contents.push(std::make_pair(start_t, std::move(content)))) break;
+         }
+         contents.close();
+      } catch (...) {
+         abort();
+      }
+   });
+
+   // parsing and cleaning stage
+   std::thread parser([&]() {
+      try {
+         std::pair<unsigned,Response> content;
+         while (contents.pop(content)) {
+            std::vector<Bar> data;
+            parseHistoData(content.second.content, content.first, data, content.second.encoding);
+            if (!blocks.push(std::move(data))) break;
+         }
+         blocks.close();
+      } catch (...) {
+         abort();
+      }
+   });
+
+   // writing stage
+   try {
+      std::vector<Bar> data;
+      while (blocks.pop(data)) {
+         ScopedTimer timer(stats().write_time);
+         write(data);
+      }
+   } catch (...) {
+      abort();
+   }
+
+   downloader.join();
+   parser.join();
+
+   if (error) {
+      std::rethrow_exception(error);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get all pairs (instrument,granularity) defined in QuotesDB.hpp
+std::vector<std::pair<std::string,std::string>> OandaAPI::getAllPairs()
+{
+   std::vector<std::pair<std::string,std::string>> pairs;
+
+   for (const auto& instrument : INSTRUMENTS) {
+      for (const auto& granularity : GRANULARITIES) {
+         pairs.emplace_back(instrument, granularity);
+      }
+   }
+
+   return pairs;
 }
 
 //================================================================================================= 
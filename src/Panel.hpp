@@ -0,0 +1,94 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef PANEL_HPP
+#define PANEL_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// series of Bars of several tables aligned on a single date axis, the union of the dates of all tables:
+// series[k] holds the Bars of tables[k] at each date of the axis, a missing Bar being filled either with
+// the previous close (open, high, low and close set to it, volume 0) or with NaN prices and volume 0
+
+class Panel
+{
+public:
+   // policy for filling missing Bars
+   enum Fill {FILL_PREVIOUS, FILL_NAN};
+
+   // common date axis
+   std::vector<unsigned> date;
+   // names of the tables
+   std::vector<std::string> tables;
+   // Bars of each table aligned on the date axis
+   std::vector<BarSeries> series;
+   // filled[k][i] is 1 if the Bar of table k at date i is missing and has been filled
+   std::vector<std::vector<char>> filled;
+
+   // parameter constructor
+   Panel(const std::vector<std::string>& tables, Fill fill = FILL_PREVIOUS);
+   // append date to the axis with a Bar for each table, null if missing
+   void append(unsigned date, const std::vector<const Bar*>& bars);
+   // get number of dates
+   std::size_t size() const { return date.size(); }
+   // get series of table, throw if the panel has no such table
+   const BarSeries& get(const std::string& tab_name) const;
+   // get fill policy
+   Fill getFill() const { return fill; }
+
+private:
+   Fill fill;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor
+Panel::Panel(const std::vector<std::string>& tables, Fill fill)
+   : tables(tables), series(tables.size()), filled(tables.size()), fill(fill) {}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append date to the axis with a Bar for each table, null if missing
+void Panel::append(unsigned date, const std::vector<const Bar*>& bars)
+{
+   this->date.push_back(date);
+
+   for (std::size_t k = 0; k < series.size(); ++k) {
+      BarSeries& s = series[k];
+
+      if (bars[k]) {
+         s.push_back(*bars[k]);
+         filled[k].push_back(0);
+         continue;
+      }
+
+      float x = std::numeric_limits<float>::quiet_NaN();
+      float y = x;
+      if (fill == FILL_PREVIOUS && !s.closeBid.empty()) {
+         x = s.closeBid.back();
+         y = s.closeAsk.back();
+      }
+      s.push_back(Bar(date, x, y, x, y, x, y, x, y, 0));
+      filled[k].push_back(1);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get series of table, throw if the panel has no such table
+const BarSeries& Panel::get(const std::string& tab_name) const
+{
+   for (std::size_t k = 0; k < tables.size(); ++k) {
+      if (tables[k] == tab_name) return series[k];
+   }
+   throw std::invalid_argument("Panel: no table " + tab_name);
+}
+
+//=================================================================================================
+
+}
+
+#endif
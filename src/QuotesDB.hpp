@@ -8,18 +8,55 @@
 //=================================================================================================
 
 #include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <queue>
+#include <list>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <type_traits>
+#include <exception>
+#include <future>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#ifdef __SSE__
+#include <xmmintrin.h>                   // for SSE intrinsics
+#endif
+
+// POSIX headers
+#include <fcntl.h>                       // for open
+#include <unistd.h>                      // for pread, pwrite
+#include <sys/mman.h>                    // for mmap
+#include <sys/stat.h>                    // for mkdir
 
 // POCO headers
+#include <Poco/Net/HTTPClientSession.h>  // for HTTPClientSession
 #include <Poco/Net/HTTPSClientSession.h> // for HTTPSClientSession
 #include <Poco/Net/HTTPRequest.h>        // for HTTPRequest
 #include <Poco/Net/HTTPResponse.h>       // for HTTPResponse
 #include <Poco/Net/SSLManager.h>         // for Context
 #include <Poco/URI.h>                    // for URI
 #include <Poco/Exception.h>              // for try/catch and Exception
-#include <Poco/JSON/Array.h>             // for Array
-#include <Poco/JSON/Object.h>            // for Object
-#include <Poco/JSON/Parser.h>            // for Parser
-#include <Poco/Dynamic/Var.h>            // for Var
+#include <Poco/DeflatingStream.h>        // for DeflatingOutputStream
+#include <Poco/InflatingStream.h>        // for InflatingInputStream
+#include <Poco/SHA1Engine.h>             // for SHA1Engine
 
 // MYSQL headers
 #include <mysql_connection.h>
@@ -32,26 +69,102 @@
 
 /*-------------------------------------------------------------------------------------------------*/
 
+// storage engine of tables written by OandaAPI and Scheduler: "mysql" or "file", an embedded engine storing each
+// table in a local file (see FileStorage.hpp) in a directory named after the database within STORAGE_DIR
+static const std::string STORAGE_ENGINE = "mysql";
+static const std::string STORAGE_DIR = "data";
+
 // MYSQL parameters 
 static const std::string URL = "tcp://127.0.0.1:3306";
 static const std::string USER = "root";
 static const std::string PASSWORD = "password";
+// number of Bars sent per multi-row INSERT statement
+static const int BATCH_SIZE = 1000;
+// number of Bars read per chunk when streaming tables
+static const std::size_t CHUNK_SIZE = 10000;
+// number of Bars per block of exported files (see Exporter.hpp), the memory used per table exported
+static const std::size_t EXPORT_BLOCK_SIZE = 65536;
+// store prices of new tables as integer numbers of pipettes instead of FLOAT(8,5), so that stored prices are exact
+// (rows are not narrower, an INTEGER column being as wide as a FLOAT one)
+static const bool FIXED_POINT_PRICES = false;
+// number of price units per unit of quote currency of instruments whose prices are stored as integers, instruments
+// not listed using pipettes (1000 for JPY pairs, 100000 otherwise), prices times scale must fit in 32 bits, 
+// for instance {{"JP225_USD",10},{"XAU_USD",1000}} for instruments quoted with 1 and 3 decimals (see the
+// precision given by OandaAPI::getInstruments)
+static const std::map<std::string,int> PRICE_SCALES = {};
+// initialize tables by bulk loading (LOAD DATA LOCAL INFILE, the server needs local_infile = ON)
+// into a staging table replacing the table once complete, instead of multi-row INSERT statements
+static const bool BULK_LOAD = false;
+// partitioning of new tables by granularity, "yearly" or "monthly" (UTC), for instance {{"M1","yearly"},{"S5","monthly"}},
+// range queries only read the partitions concerned and reloading a range only rewrites its partitions
+static const std::map<std::string,std::string> PARTITIONING = {};
+// file the metrics of the process (see Metrics.hpp) are written to after each run, in JSON if its name ends
+// with ".json", in Prometheus text format otherwise (for the node exporter textfile collector), none if empty
+static const std::string METRICS_FILE = "";
+// number of connections opened by a ConnectionPool when created, and maximum number open at once
+static const int POOL_MIN_SIZE = 1;
+static const int POOL_MAX_SIZE = 8;
 
 // OANDA parameters
 static const std::string ACCOUNT_ID = " ";
 static const std::string ACCESS_TOKEN = " ";
+// maximum number of candles per request allowed by Oanda
+static const int BLOCK_SIZE = 5000;
+// percentage of each block left free when planning blocks on trading hours, for candles Oanda 
+// returns in periods considered off (see getDates)
+static const int BLOCK_HEADROOM = 10;
+// number of blocks of data allowed to wait between two stages of the download pipeline
+static const int PIPELINE_DEPTH = 2;
+// number of keep-alive sessions, hence of requests running concurrently
+static const int HTTP_SESSIONS = 4;
+// maximum number of requests sent per second, to stay within the broker limits
+static const double MAX_REQUESTS_PER_SECOND = 15;
+// number of times a request failing with a transient error is retried, and delay before the first retry 
+// in milliseconds (doubled after each retry)
+static const int MAX_RETRIES = 4;
+static const int RETRY_DELAY = 500;
+// timeout of requests in seconds
+static const int HTTP_TIMEOUT = 60;
+// request responses compressed (gzip or deflate), they are inflated by chunks while being parsed
+static const bool HTTP_COMPRESSION = true;
+// delay in seconds after a Bar close before requesting it in scheduler mode, and number of attempts
+// before waiting for the next close when the Bar is not available yet
+static const int SCHEDULER_DELAY = 2;
+static const int SCHEDULER_RETRIES = 5;
+// minimum duration in seconds of consecutive Bars missing from a table for a gap to be reported by GapScanner,
+// at least one Bar (Oanda returns no Bar when there was no tick, which is frequent for small granularities)
+static const int GAP_MIN_SECONDS = 3600;
 
 // instruments selected
 static const std::string INSTRUMENTS[] = {"EUR_USD","GBP_USD","USD_JPY"};
 // granularities selected
 static const std::string GRANULARITIES[] = {"D","H4","H1"};
+// granularities built locally from a downloaded one instead of being downloaded, as pairs (source,derived),
+// for instance {{"H1","H4"},{"H1","D"}} with GRANULARITIES = {"H1"} only downloads H1 data
+static const std::vector<std::pair<std::string,std::string>> DERIVED_GRANULARITIES = {};
 
 /*-------------------------------------------------------------------------------------------------*/
 
+#include "Concurrency.hpp"
+#include "Metrics.hpp"
 #include "DateTime.hpp"
 #include "Bar.hpp"
+#include "CandleParser.hpp"
+#include "BarSeries.hpp"
+#include "Panel.hpp"
+#include "BarCache.hpp"
+#include "ConnectionPool.hpp"
+#include "Storage.hpp"
 #include "DataBase.hpp"
+#include "BarStore.hpp"
+#include "FileStorage.hpp"
+#include "Resampler.hpp"
+#include "ResponseCache.hpp"
+#include "RequestEngine.hpp"
 #include "OandaAPI.hpp"
+#include "Scheduler.hpp"
+#include "GapScanner.hpp"
+#include "Exporter.hpp"
 
 //================================================================================================
 
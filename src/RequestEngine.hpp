@@ -0,0 +1,448 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef REQUESTENGINE_HPP
+#define REQUESTENGINE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// thread safe engine sending GET requests to a server through a set of keep-alive sessions,
+// requests from several threads run concurrently on distinct sessions, they are spaced out so that
+// at most max_rate requests per second are sent and retried with exponential backoff on transient
+// failures (network errors, HTTP 429 and 5xx), any other status than 2xx failing at once, responses
+// are requested compressed (gzip or deflate) if HTTP_COMPRESSION is set and inflated by chunks as
+// they are read
+
+class RequestEngine
+{
+public:
+   // parameter constructor, base_url being for instance "https://api-fxpractice.oanda.com"
+   RequestEngine(const std::string& base_url, int nb_sessions = HTTP_SESSIONS, double max_rate = MAX_REQUESTS_PER_SECOND);
+   // set header sent with every request, to be called before sending any request
+   void setHeader(const std::string& name, const std::string& value);
+   // send GET request for endpoint and return response content
+   std::string get(const std::string& endpoint);
+   // send GET request for endpoint passing response content by chunks to consume(p,n) as it is received
+   // NB: once part of the content has been consumed a failure is not retried
+   void get(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume);
+   // send GET request for endpoint and return response content as received, still compressed, along with 
+   // its encoding (empty if not compressed), for decoding it later with decode
+   std::string getEncoded(const std::string& endpoint, std::string& encoding);
+   // pass content received with encoding by chunks to consume(p,n) as it is decoded
+   static void decode(const std::string& content, const std::string& encoding, const std::function<void(const char*,std::size_t)>& consume);
+   // get maximum number of requests running concurrently
+   int getSessions() const { return nb_sessions; }
+
+private:
+   std::string base_url;
+   int nb_sessions;
+   // headers sent with every request
+   std::vector<std::pair<std::string,std::string>> headers;
+   // idle sessions, the most recently used last
+   std::vector<std::unique_ptr<Poco::Net::HTTPClientSession>> sessions;
+   // number of sessions open, used or idle
+   int nb_open;
+   std::mutex m;
+   std::condition_variable released;
+   // minimum time between two requests and time at which the next request can be sent
+   std::chrono::steady_clock::duration interval;
+   std::chrono::steady_clock::time_point next_slot;
+   std::mutex rate_mutex;
+
+   // input stream buffer reading from another stream by chunks and counting bytes read
+   class CountingBuffer : public std::streambuf
+   {
+   public:
+      // parameter constructor
+      CountingBuffer(std::istream& in, Counter& counter) : in(in), counter(counter) {}
+
+   protected:
+      // read next chunk
+      int_type underflow();
+
+   private:
+      std::istream& in;
+      Counter& counter;
+      char buf[16384];
+   };
+
+   // input stream buffer reading from memory
+   class MemoryBuffer : public std::streambuf
+   {
+   public:
+      // parameter constructor
+      MemoryBuffer(const char* p, std::size_t n) { char* q = const_cast<char*>(p); setg(q, q, q + n); }
+   };
+
+   // metrics shared by all engines (see Metrics.hpp)
+   struct Stats
+   {
+      // time from sending a request to receiving the response headers
+      Histogram& latency;
+      Counter& requests;
+      Counter& retries;
+      Counter& failures;
+      Counter& bytes_received;
+   };
+
+   // get an idle session, opening a new one if less than nb_sessions are open, waiting otherwise
+   std::unique_ptr<Poco::Net::HTTPClientSession> acquire();
+   // give back a session
+   void release(std::unique_ptr<Poco::Net::HTTPClientSession> session);
+   // open a new session to server
+   std::unique_ptr<Poco::Net::HTTPClientSession> connect() const;
+   // wait until a request can be sent without exceeding max_rate
+   void wait_slot();
+   // send GET request for endpoint passing response content by chunks to consume(p,n), decoded if decode is true, 
+   // encoding being set to the encoding of the content passed
+   void send(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume, bool decode, std::string& encoding);
+   // read stream by chunks passing them to consume(p,n), inflating them if encoding is gzip or deflate
+   static void read(std::istream& in, const std::string& encoding, const std::function<void(const char*,std::size_t)>& consume);
+   // check whether a request failing with HTTP status can be retried
+   static bool is_transient(int status);
+   // get metrics shared by all engines
+   static Stats& stats();
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, base_url being for instance "https://api-fxpractice.oanda.com"
+RequestEngine::RequestEngine(const std::string& base_url, int nb_sessions, double max_rate)
+   : base_url(base_url), nb_sessions(std::max(nb_sessions, 1)), nb_open(0), next_slot(std::chrono::steady_clock::now())
+{
+   while (!this->base_url.empty() && this->base_url.back() == '/') this->base_url.pop_back();
+
+   if (max_rate > 0) {
+      interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1. / max_rate));
+   }
+   else {
+      // no rate limit
+      interval = std::chrono::steady_clock::duration::zero();
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// set header sent with every request, to be called before sending any request
+void RequestEngine::setHeader(const std::string& name, const std::string& value)
+{
+   headers.emplace_back(name, value);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// send GET request for endpoint and return response content
+std::string RequestEngine::get(const std::string& endpoint)
+{
+   std::string content;
+
+   get(endpoint, [&content](const char* p, std::size_t n) { content.append(p, n); });
+
+   return content;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// send GET request for endpoint passing response content by chunks to consume(p,n) as it is received
+void RequestEngine::get(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume)
+{
+   std::string encoding;
+
+   send(endpoint, consume, true, encoding);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// send GET request for endpoint and return response content as received, still compressed, along with 
+// its encoding (empty if not compressed), for decoding it later with decode
+std::string RequestEngine::getEncoded(const std::string& endpoint, std::string& encoding)
+{
+   std::string content;
+
+   send(endpoint, [&content](const char* p, std::size_t n) { content.append(p, n); }, false, encoding);
+
+   return content;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// pass content received with encoding by chunks to consume(p,n) as it is decoded
+void RequestEngine::decode(const std::string& content, const std::string& encoding, const std::function<void(const char*,std::size_t)>& consume)
+{
+   if (encoding.empty()) {
+      consume(content.data(), content.size());
+      return;
+   }
+
+   MemoryBuffer buf(content.data(), content.size());
+   std::istream in(&buf);
+
+   read(in, encoding, consume);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// send GET request for endpoint passing response content by chunks to consume(p,n), decoded if decode is true, 
+// encoding being set to the encoding of the content passed
+// NB: once part of the content has been consumed a failure is not retried
+void RequestEngine::send(const std::string& endpoint, const std::function<void(const char*,std::size_t)>& consume, bool decode, std::string& encoding)
+{
+   // building URI
+   Poco::URI uri(base_url + endpoint);
+   // preparing path
+   std::string path(uri.getPathAndQuery());
+   if (path.empty()) path = "/";
+
+   std::chrono::milliseconds delay(RETRY_DELAY);
+
+   for (int attempt = 0;; ++attempt) {
+      wait_slot();
+
+      std::unique_ptr<Poco::Net::HTTPClientSession> session = acquire();
+      bool consumed = false;
+      // set if the server refused the request, which is not retried
+      bool rejected = false;
+      std::string error;
+
+      try {
+         // sending request to receive data from server
+         Poco::Net::HTTPRequest req(Poco::Net::HTTPRequest::HTTP_GET, path, Poco::Net::HTTPMessage::HTTP_1_1);
+         for (const auto& header : headers) req.set(header.first, header.second);
+         if (HTTP_COMPRESSION) req.set("Accept-Encoding", "gzip, deflate");
+         stats().requests.add();
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+         session->sendRequest(req);
+
+         Poco::Net::HTTPResponse res;
+         // getting response
+         std::istream& rs = session->receiveResponse(res);
+         stats().latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+         int status = res.getStatus();
+         std::string content_encoding = res.get("Content-Encoding", "");
+         std::transform(content_encoding.begin(), content_encoding.end(), content_encoding.begin(), ::tolower);
+         if (content_encoding == "identity") content_encoding.clear();
+
+         if (status >= 200 && status < 300) {
+            // counting bytes as received, before inflating them
+            CountingBuffer buf(rs, stats().bytes_received);
+            std::istream in(&buf);
+
+            // reading response by chunks
+            encoding = decode ? "" : content_encoding;
+            read(in, decode ? content_encoding : "", [&](const char* p, std::size_t n) {
+               consumed = true;
+               consume(p, n);
+            });
+            release(std::move(session));
+            return;
+         }
+         error = "HTTP status " + std::to_string(status) + " " + res.getReason();
+         if (!is_transient(status)) {
+            // keeping the beginning of the error message returned by the server, the request being wrong
+            // (bad parameters, authorization...) it would fail again
+            std::string message;
+            try {
+               read(rs, content_encoding, [&message](const char* p, std::size_t n) {
+                  if (message.size() < 512) message.append(p, std::min<std::size_t>(n, 512 - message.size()));
+               });
+            } catch (const Poco::Exception&) {}
+            if (!message.empty()) error += ": " + message;
+            rejected = true;
+         }
+         // dropping the unread response
+         session->reset();
+
+      } catch (const Poco::Exception& e) {
+         session->reset();
+         release(std::move(session));
+         if (consumed || attempt >= MAX_RETRIES) {
+            stats().failures.add();
+            throw;
+         }
+         error = e.displayText();
+      } catch (...) {
+         // error raised by consume
+         session->reset();
+         release(std::move(session));
+         throw;
+      }
+
+      if (session) release(std::move(session));
+
+      if (rejected) {
+         stats().failures.add();
+         throw std::runtime_error("RequestEngine: GET " + path + " failed: " + error);
+      }
+      if (attempt >= MAX_RETRIES) {
+         stats().failures.add();
+         throw std::runtime_error("RequestEngine: GET " + path + " failed after " + std::to_string(attempt + 1) + " attempts: " + error);
+      }
+
+      stats().retries.add();
+      print("retrying GET " + path + " in " + std::to_string(delay.count()) + "ms after error: " + error + "\n");
+      std::this_thread::sleep_for(delay);
+      delay *= 2;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get an idle session, opening a new one if less than nb_sessions are open, waiting otherwise
+std::unique_ptr<Poco::Net::HTTPClientSession> RequestEngine::acquire()
+{
+   std::unique_lock<std::mutex> lock(m);
+
+   released.wait(lock, [this]() { return !sessions.empty() || nb_open < nb_sessions; });
+
+   if (sessions.empty()) {
+      // opening a new session outside the lock
+      ++nb_open;
+      lock.unlock();
+      try {
+         return connect();
+      } catch (...) {
+         lock.lock();
+         --nb_open;
+         released.notify_one();
+         throw;
+      }
+   }
+
+   std::unique_ptr<Poco::Net::HTTPClientSession> session = std::move(sessions.back());
+   sessions.pop_back();
+
+   return session;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// give back a session
+void RequestEngine::release(std::unique_ptr<Poco::Net::HTTPClientSession> session)
+{
+   std::lock_guard<std::mutex> lock(m);
+   sessions.push_back(std::move(session));
+   released.notify_one();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// open a new session to server
+std::unique_ptr<Poco::Net::HTTPClientSession> RequestEngine::connect() const
+{
+   std::unique_ptr<Poco::Net::HTTPClientSession> session;
+
+   Poco::URI uri(base_url);
+   if (uri.getScheme() == "http") {
+      // implementing the client-side of a plain HTTP session
+      session.reset(new Poco::Net::HTTPClientSession(uri.getHost(),uri.getPort()));
+   }
+   else {
+      // context information for a Secure Socket Layer (SSL) client
+      const Poco::Net::Context::Ptr context = new Poco::Net::Context(
+                                                  Poco::Net::Context::CLIENT_USE,"","","",
+                                                  Poco::Net::Context::VERIFY_NONE,9,false,
+                                                  "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH");
+      // implementing the client-side of an HTTP Secure session
+      session.reset(new Poco::Net::HTTPSClientSession(uri.getHost(),uri.getPort(),context));
+   }
+   // keeping the connection alive
+   session->setKeepAlive(true);
+   session->setTimeout(Poco::Timespan(HTTP_TIMEOUT, 0));
+
+   return session;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// wait until a request can be sent without exceeding max_rate
+void RequestEngine::wait_slot()
+{
+   std::chrono::steady_clock::time_point slot;
+   {
+      std::lock_guard<std::mutex> lock(rate_mutex);
+      slot = std::max(next_slot, std::chrono::steady_clock::now());
+      next_slot = slot + interval;
+   }
+   std::this_thread::sleep_until(slot);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read stream by chunks passing them to consume(p,n), inflating them if encoding is gzip or deflate
+// NB: an error reading or inflating the stream is raised as a Poco::IOException
+void RequestEngine::read(std::istream& in, const std::string& encoding, const std::function<void(const char*,std::size_t)>& consume)
+{
+   std::unique_ptr<std::istream> inflater;
+
+   if (encoding == "gzip" || encoding == "x-gzip") {
+      inflater.reset(new Poco::InflatingInputStream(in, Poco::InflatingStreamBuf::STREAM_GZIP));
+   }
+   else if (encoding == "deflate") {
+      inflater.reset(new Poco::InflatingInputStream(in, Poco::InflatingStreamBuf::STREAM_ZLIB));
+   }
+   else if (!encoding.empty()) {
+      throw std::runtime_error("RequestEngine: unsupported content encoding " + encoding);
+   }
+
+   std::istream& is = inflater ? *inflater : in;
+
+   char buf[16384];
+   while (is) {
+      is.read(buf, sizeof(buf));
+      if (is.gcount() > 0) consume(buf, is.gcount());
+   }
+   if (is.bad()) {
+      throw Poco::IOException("RequestEngine: cannot read " + (encoding.empty() ? std::string("response") : encoding + " response"));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read next chunk
+RequestEngine::CountingBuffer::int_type RequestEngine::CountingBuffer::underflow()
+{
+   in.read(buf, sizeof(buf));
+   std::streamsize n = in.gcount();
+   if (n <= 0) {
+      // reporting a failure of the stream read as an error
+      if (in.bad()) throw Poco::IOException("RequestEngine: cannot read response");
+      return traits_type::eof();
+   }
+
+   counter.add(n);
+   setg(buf, buf, buf + n);
+
+   return traits_type::to_int_type(buf[0]);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// check whether a request failing with HTTP status can be retried
+bool RequestEngine::is_transient(int status)
+{
+   // too many requests or server error
+   return status == 429 || (status >= 500 && status < 600);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get metrics shared by all engines, looked up once
+RequestEngine::Stats& RequestEngine::stats()
+{
+   static Stats s = {metrics().histogram("http_latency_seconds"),
+                     metrics().counter("http_requests_total"),
+                     metrics().counter("http_retries_total"),
+                     metrics().counter("http_failures_total"),
+                     metrics().counter("http_bytes_received_total")};
+   return s;
+}
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,207 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// aggregate Bars sorted by date into Bars of a coarser granularity, periods being aligned 
+// on 17:00 US/Eastern as Oanda candles and the day offs defined by is_day_off are
+
+class Resampler
+{
+public:
+   // parameter constructor, granularity must divide a day (S5 to S30, M1 to M30, H1 to H12, D)
+   explicit Resampler(const std::string& granularity);
+   // get UTC opening date of the period containing UTC date
+   unsigned period_start(unsigned date) const;
+   // get UTC closing date of the period opening at UTC date start
+   unsigned period_end(unsigned start) const;
+   // add next Bar, appending the current aggregated Bar to out once a Bar from a later period is added
+   void add(const Bar& x, std::vector<Bar>& out);
+   // append the current aggregated Bar to out if the last Bar added, lasting src_secs seconds, is the last one of its period
+   void flush(int src_secs, std::vector<Bar>& out);
+   // append the current aggregated Bar to out whatever the last Bar added
+   void close(std::vector<Bar>& out);
+
+private:
+   // period length in seconds
+   int nb_secs;
+   // Bar being aggregated
+   Bar current;
+   bool empty;
+   // date of the last Bar added
+   unsigned last_date;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, granularity must divide a day (S5 to S30, M1 to M30, H1 to H12, D)
+Resampler::Resampler(const std::string& granularity) : nb_secs(granularity_to_sec(granularity)), empty(true), last_date(0)
+{
+   if (nb_secs == 0 || 86400 % nb_secs != 0) {
+      throw std::invalid_argument("Resampler: unsupported granularity " + granularity);
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC opening date of the period containing UTC date
+unsigned Resampler::period_start(unsigned date) const
+{
+   // periods are counted in local time from 17:00 US/Eastern
+   time_t local = utc_to_est(static_cast<time_t>(date)) - 17 * 3600;
+   time_t start = local - ((local % nb_secs) + nb_secs) % nb_secs + 17 * 3600;
+
+   return est_to_utc(start);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC closing date of the period opening at UTC date start
+unsigned Resampler::period_end(unsigned start) const
+{
+   // NB: a daily period lasts 23 or 25 hours when daylight saving time starts or ends
+   return est_to_utc(utc_to_est(static_cast<time_t>(start)) + nb_secs);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add next Bar, appending the current aggregated Bar to out once a Bar from a later period is added
+void Resampler::add(const Bar& x, std::vector<Bar>& out)
+{
+   unsigned start = period_start(x.date);
+   last_date = x.date;
+
+   if (!empty && start == current.date) {
+      current.highBid = std::max(current.highBid, x.highBid);
+      current.highAsk = std::max(current.highAsk, x.highAsk);
+      current.lowBid = std::min(current.lowBid, x.lowBid);
+      current.lowAsk = std::min(current.lowAsk, x.lowAsk);
+      current.closeBid = x.closeBid;
+      current.closeAsk = x.closeAsk;
+      current.volume += x.volume;
+      return;
+   }
+   if (!empty) {
+      out.push_back(current);
+   }
+   current = x;
+   current.date = start;
+   empty = false;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append the current aggregated Bar to out if the last Bar added, lasting src_secs seconds, is the last one of its period
+// NB: the period is decided by the source Bars and not by the clock, a period whose last Bars are not recorded yet
+// is left open and aggregated again on the next update
+void Resampler::flush(int src_secs, std::vector<Bar>& out)
+{
+   if (!empty && last_date + src_secs >= period_end(current.date)) {
+      out.push_back(current);
+      empty = true;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append the current aggregated Bar to out whatever the last Bar added
+void Resampler::close(std::vector<Bar>& out)
+{
+   if (!empty) {
+      out.push_back(current);
+      empty = true;
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// build or update table dst_tab of granularity from the finer table src_tab of granularity src_granularity, only closed 
+// periods (followed by a later source Bar or ending with the last source Bar) are written
+// if init is true dst_tab is re-initialized, otherwise only periods after its last Bar are added
+// return number of Bars written
+std::size_t resample_table(DataBase& db, const std::string& src_tab, const std::string& src_granularity, 
+                           const std::string& dst_tab, const std::string& granularity, bool init)
+{
+   Resampler resampler(granularity);
+   int src_secs = granularity_to_sec(src_granularity);
+   if (src_secs == 0) {
+      throw std::invalid_argument("resample_table: unsupported granularity " + src_granularity);
+   }
+
+   // first source date to aggregate
+   unsigned start = 0;
+   if (init) {
+      // same price layout as the source table
+      db.create_table(dst_tab, db.get_price_scale(src_tab) ? DataBase::FIXED_PRICES : DataBase::FLOAT_PRICES, db.get_partitioning(src_tab));
+   }
+   else {
+      Bar last;
+      if (db.get_last_row(dst_tab, last)) start = resampler.period_end(last.date);
+   }
+
+   // streaming source Bars by chunks
+   DataBase::Cursor cursor = db.open_cursor(src_tab, sec_to_string(start), sec_to_string(std::numeric_limits<unsigned>::max()));
+   std::vector<Bar> data;
+   std::vector<Bar> bars;
+
+   while (cursor.next(data)) {
+      for (const auto& x : data) {
+         resampler.add(x, bars);
+      }
+   }
+   resampler.flush(src_secs, bars);
+
+   // NB: the cursor keeps the connection busy until exhausted, aggregated Bars are written afterwards
+   db.write_table(dst_tab, bars);
+
+   return bars.size();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// rebuild Bars of table dst_tab of granularity whose periods overlap dates [start_t,end_t] from the finer table src_tab
+// of granularity src_granularity, after Bars of src_tab in this range have been replaced, return number of Bars written
+std::size_t resample_range(DataBase& db, const std::string& src_tab, const std::string& src_granularity, 
+                           const std::string& dst_tab, const std::string& granularity, unsigned start_t, unsigned end_t)
+{
+   Resampler resampler(granularity);
+   int src_secs = granularity_to_sec(src_granularity);
+   if (src_secs == 0) {
+      throw std::invalid_argument("resample_range: unsupported granularity " + src_granularity);
+   }
+
+   // dates of the periods overlapping the range
+   unsigned first = resampler.period_start(start_t);
+   unsigned last = resampler.period_end(resampler.period_start(end_t)) - 1;
+
+   DataBase::Cursor cursor = db.open_cursor(src_tab, sec_to_string(first), sec_to_string(last));
+   std::vector<Bar> data;
+   std::vector<Bar> bars;
+
+   while (cursor.next(data)) {
+      for (const auto& x : data) {
+         resampler.add(x, bars);
+      }
+   }
+   // the last period is closed if the source table goes beyond it
+   Bar x;
+   if (db.get_last_row(src_tab, x) && x.date > last) resampler.close(bars);
+   else resampler.flush(src_secs, bars);
+
+   db.clear_range(dst_tab, sec_to_string(first), sec_to_string(last));
+   db.write_table(dst_tab, bars);
+
+   return bars.size();
+}
+
+//=================================================================================================
+
+}
+
+#endif
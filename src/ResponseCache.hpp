@@ -0,0 +1,134 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef RESPONSECACHE_HPP
+#define RESPONSECACHE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// local cache of raw server responses, each response is stored gzip compressed in its own file
+// of directory dir named after the SHA1 digest of the server domain and its key (responses of
+// different servers are kept apart), so that it can be shared between threads and processes: a file
+// is written under a temporary name and renamed once complete
+
+class ResponseCache
+{
+public:
+   // parameter constructor, create directory dir if it does not exist, responses coming from server domain
+   ResponseCache(const std::string& dir, const std::string& domain = "");
+   // get response stored for key, return false if there is none
+   bool get(const std::string& key, std::string& content) const;
+   // store response for key, replacing any previous one
+   void put(const std::string& key, const std::string& content) const;
+   // remove response stored for key if any
+   void remove(const std::string& key) const;
+   // get directory of the cache
+   const std::string& directory() const { return dir; }
+
+private:
+   std::string dir;
+   std::string domain;
+
+   // get path of the file storing response for key
+   std::string path(const std::string& key) const;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, create directory dir if it does not exist, responses coming from server domain
+ResponseCache::ResponseCache(const std::string& dir, const std::string& domain) : dir(dir), domain(domain)
+{
+   while (this->dir.size() > 1 && this->dir.back() == '/') this->dir.pop_back();
+
+   mkdir(this->dir.c_str(), 0755);
+
+   struct stat st;
+   if (stat(this->dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+      throw std::runtime_error("ResponseCache: cannot create directory " + this->dir + ": " + std::strerror(errno));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get response stored for key, return false if there is none
+bool ResponseCache::get(const std::string& key, std::string& content) const
+{
+   std::ifstream file(path(key), std::ios::binary);
+   if (!file) return false;
+
+   std::string buffer;
+   try {
+      Poco::InflatingInputStream inflater(file, Poco::InflatingStreamBuf::STREAM_GZIP);
+      char buf[16384];
+      while (inflater) {
+         inflater.read(buf, sizeof(buf));
+         buffer.append(buf, inflater.gcount());
+      }
+      if (inflater.bad()) return false;
+   } catch (const Poco::Exception&) {
+      // corrupted file, it will be downloaded and stored again
+      return false;
+   }
+
+   content.swap(buffer);
+
+   return true;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// store response for key, replacing any previous one
+void ResponseCache::put(const std::string& key, const std::string& content) const
+{
+   std::string file_path = path(key);
+   // temporary file unique to this thread of this process
+   std::string tmp_path = file_path + ".tmp" + std::to_string(getpid()) + "_" +
+                          std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+   {
+      std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+      if (!file) {
+         throw std::runtime_error("ResponseCache: cannot open " + tmp_path + ": " + std::strerror(errno));
+      }
+      Poco::DeflatingOutputStream deflater(file, Poco::DeflatingStreamBuf::STREAM_GZIP);
+      deflater.write(content.data(), content.size());
+      deflater.close();
+      file.close();
+      if (!file) {
+         std::remove(tmp_path.c_str());
+         throw std::runtime_error("ResponseCache: cannot write " + tmp_path);
+      }
+   }
+
+   if (std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("ResponseCache: cannot rename " + tmp_path + ": " + std::strerror(errno));
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// remove response stored for key if any
+void ResponseCache::remove(const std::string& key) const
+{
+   std::remove(path(key).c_str());
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get path of the file storing response for key
+std::string ResponseCache::path(const std::string& key) const
+{
+   Poco::SHA1Engine sha1;
+   sha1.update(domain + key);
+
+   return dir + "/" + Poco::DigestEngine::digestToHex(sha1.digest()) + ".json.gz";
+}
+
+//=================================================================================================
+
+}
+
+#endif
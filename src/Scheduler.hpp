@@ -0,0 +1,259 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// long running updater keeping tables up to date: the date of the last Bar of each table is kept in memory,
+// the scheduler sleeps until the next Bar of one of the tables closes and then only requests the Bars
+// closed since the last one recorded, tables due at the same time being requested concurrently
+
+class Scheduler
+{
+public:
+   // parameter constructor, tables in database db_name are updated from Oanda through api, in the storage
+   // engine STORAGE_ENGINE
+   Scheduler(const OandaAPI& api, const std::string& db_name);
+   // add table for pair instrument & granularity, it must have been initialized
+   void add(const std::string& instrument, const std::string& granularity);
+   // add tables for all pairs (INSTRUMENTS,GRANULARITIES) defined in QuotesDB.hpp
+   void addAll();
+   // bring every table up to date then append new Bars as soon as they close, until stop is called
+   void run();
+   // stop running, can be called from any thread
+   void stop();
+
+private:
+   // table kept up to date
+   struct Job
+   {
+      std::string instrument;
+      std::string granularity;
+      // duration of Bars in seconds, 0 for monthly Bars
+      int nb_secs;
+      // date of the last Bar recorded
+      unsigned last_date;
+      // UTC date of the next Bar close in seconds since epoch
+      time_t next_close;
+      // UTC date at which Bars up to next_close are requested
+      time_t next_try;
+      // number of times the Bar closing at next_close has been requested without success
+      int nb_tries;
+   };
+
+   const OandaAPI& api;
+   std::string db_name;
+   std::vector<Job> jobs;
+   bool stopped;
+   std::mutex m;
+   std::condition_variable wake;
+
+   // get UTC date of the first Bar close of nb_secs seconds strictly after UTC date t, Bars longer
+   // than a day being checked at the end of every trading day
+   static time_t next_close(time_t t, int nb_secs);
+   // request Bars closed since the last one recorded for job, up to UTC date end
+   std::vector<Bar> fetch(const Job& job, time_t end) const;
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// parameter constructor, tables in database db_name are updated from Oanda through api
+Scheduler::Scheduler(const OandaAPI& api, const std::string& db_name) : api(api), db_name(db_name), stopped(false) {}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add table for pair instrument & granularity, it must have been initialized
+void Scheduler::add(const std::string& instrument, const std::string& granularity)
+{
+   int nb_secs = granularity_to_sec(granularity);
+   if (nb_secs == 0 && granularity != "M") {
+      throw std::invalid_argument("Scheduler: unsupported granularity " + granularity);
+   }
+
+   Job job;
+   job.instrument = instrument;
+   job.granularity = granularity;
+   job.nb_secs = nb_secs;
+   job.last_date = 0;
+   job.next_close = 0;
+   job.next_try = 0;
+   job.nb_tries = 0;
+
+   jobs.push_back(job);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// add tables for all pairs (INSTRUMENTS,GRANULARITIES) defined in QuotesDB.hpp
+void Scheduler::addAll()
+{
+   for (const auto& instrument : INSTRUMENTS) {
+      for (const auto& granularity : GRANULARITIES) {
+         add(instrument, granularity);
+      }
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// bring every table up to date then append new Bars as soon as they close, until stop is called
+void Scheduler::run()
+{
+   std::unique_ptr<Storage> storage = open_storage(db_name);
+   Storage& db = *storage;
+   // MySQL connection, null with another storage engine
+   DataBase* mysql = dynamic_cast<DataBase*>(storage.get());
+
+   // catching up with the usual update, the only time the last row of each table is read
+   for (auto& job : jobs) {
+      std::string tab_name = job.instrument + "_" + job.granularity;
+      Bar x;
+      if (!db.get_last_row(tab_name, x)) {
+         print("table " + tab_name + " is empty or missing, it will not be updated\n");
+         continue;
+      }
+      api.updateTab(db, job.instrument, job.granularity);
+      db.get_last_row(tab_name, x);
+      job.last_date = x.date;
+      job.next_close = next_close(time(nullptr), job.nb_secs);
+      // leaving the server some time to complete the Bar
+      job.next_try = job.next_close + SCHEDULER_DELAY;
+   }
+
+   std::unique_lock<std::mutex> lock(m);
+
+   while (!stopped) {
+      // waking up at the first Bar close
+      time_t due = std::numeric_limits<time_t>::max();
+      for (const auto& job : jobs) {
+         if (job.last_date > 0) due = std::min(due, job.next_try);
+      }
+      if (due == std::numeric_limits<time_t>::max()) break;
+
+      auto wake_time = std::chrono::system_clock::from_time_t(due);
+      if (wake.wait_until(lock, wake_time, [this]() { return stopped; })) break;
+
+      lock.unlock();
+
+      // requesting new Bars of all tables due concurrently
+      time_t now = time(nullptr);
+      std::vector<std::pair<Job*,std::future<std::vector<Bar>>>> pending;
+      for (auto& job : jobs) {
+         if (job.last_date > 0 && job.next_try <= now) {
+            const Job* p = &job;
+            time_t end = now;
+            pending.emplace_back(&job, std::async(std::launch::async, [this, p, end]() { return fetch(*p, end); }));
+         }
+      }
+
+      for (auto& elem : pending) {
+         Job& job = *elem.first;
+         std::string tab_name = job.instrument + "_" + job.granularity;
+         std::vector<Bar> data;
+         try {
+            data = elem.second.get();
+         } catch (const std::exception& e) {
+            print("updating " + tab_name + " failed: " + e.what() + "\n");
+         }
+
+         if (!data.empty()) {
+            print("appending " + std::to_string(data.size()) + " Bar(s) to table " + tab_name + "\n");
+            db.write_table(tab_name, data);
+            if (mysql) api.deriveTabs(*mysql, job.instrument, job.granularity, false);
+            job.last_date = data.back().date;
+         }
+
+         // Bars are marked complete by the server with a small delay, trying again a few times
+         // before waiting for the next close (there is no Bar when there was no tick)
+         bool received = !data.empty();
+         if (received && job.nb_secs > 0 && 86400 % job.nb_secs == 0) {
+            // opening date of the Bar closing at next_close, the last of a trading day being shorter
+            // when daylight saving time changes
+            time_t day_start = trading_day_start(job.next_close - 1);
+            received = job.last_date >= day_start + (job.next_close - 1 - day_start) / job.nb_secs * job.nb_secs;
+         }
+         if (!received && ++job.nb_tries < SCHEDULER_RETRIES) {
+            job.next_try = now + SCHEDULER_DELAY;
+         }
+         else {
+            job.nb_tries = 0;
+            job.next_close = next_close(std::max(job.next_close, now - SCHEDULER_DELAY), job.nb_secs);
+            job.next_try = job.next_close + SCHEDULER_DELAY;
+         }
+      }
+
+      save_metrics();
+
+      lock.lock();
+   }
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// stop running, can be called from any thread
+void Scheduler::stop()
+{
+   std::lock_guard<std::mutex> lock(m);
+   stopped = true;
+   wake.notify_all();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC date of the first Bar close of nb_secs seconds strictly after UTC date t, Bars longer
+// than a day being checked at the end of every trading day
+time_t Scheduler::next_close(time_t t, int nb_secs)
+{
+   time_t close = 0;
+
+   // no Bar closes during days off
+   for_each_trading_day(t, std::numeric_limits<time_t>::max(), [&](time_t day_start, time_t day_end) -> bool {
+      // Bars are aligned on the start of trading days
+      close = day_end;
+      if (nb_secs > 0 && 86400 % nb_secs == 0) {
+         close = std::min(day_start + ((std::max(t, day_start) - day_start) / nb_secs + 1) * nb_secs, day_end);
+      }
+      return false;
+   });
+
+   return close;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// request Bars closed since the last one recorded for job, up to UTC date end
+std::vector<Bar> Scheduler::fetch(const Job& job, time_t end) const
+{
+   std::vector<Bar> data;
+
+   std::vector<std::string> parameters = {"start=" + string_to_oanda(sec_to_string(job.last_date + 1)),
+                                          "end=" + string_to_oanda(sec_to_string(end)),
+                                          "candleFormat=bidask",
+                                          "granularity=" + job.granularity};
+
+   // falling back to the pipeline if too many Bars are missing for a single request
+   if (job.nb_secs > 0 && (end - job.last_date) / job.nb_secs > api.getBlockSize()) {
+      std::vector<std::string> dates = getDates(sec_to_string(job.last_date + 1), sec_to_string(end), job.granularity, api.getBlockSize());
+      for (std::size_t i = 0; i + 1 < dates.size(); ++i) {
+         parameters[0] = "start=" + dates[i];
+         parameters[1] = "end=" + dates[i + 1];
+         api.getHistoData(job.instrument, parameters, data);
+      }
+      return data;
+   }
+
+   api.getHistoData(job.instrument, parameters, data);
+
+   return data;
+}
+
+//=================================================================================================
+
+}
+
+#endif
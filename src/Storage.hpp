@@ -0,0 +1,50 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+namespace qdb {
+
+//=================================================================================================
+
+// interface of the storage engines tables of Bars are written to and read from: MySQL (see DataBase)
+// or local files (see FileStorage), the engine used by the ingest path being chosen by STORAGE_ENGINE
+// in QuotesDB.hpp (see open_storage)
+// NB: like a database connection, an engine object must not be used by several threads at once
+
+class Storage
+{
+public:
+   // layout of price columns: FLOAT(8,5) or integer numbers of pipettes (exact stored prices, no conversion from decimal
+   // in the server, rows being as wide)
+   enum PriceFormat {FLOAT_PRICES, FIXED_PRICES};
+   // partitioning of tables by range of dates: none, one partition per year or one per month (UTC), partitions 
+   // being added as data arrive so that date range queries only read the partitions concerned
+   enum Partitioning {NO_PARTITIONS, YEARLY_PARTITIONS, MONTHLY_PARTITIONS};
+
+   // destructor
+   virtual ~Storage() {}
+   // create or re-initialize a table to contain Bars, with prices stored in the given format and partitioned
+   // by ranges of dates, engines not supporting a layout ignoring it
+   virtual void create_table(const std::string& tab_name, PriceFormat format = FLOAT_PRICES, Partitioning partitioning = NO_PARTITIONS) = 0;
+   // write to table appending new Bars, Bars whose date is already recorded being skipped if skip_existing
+   virtual void write_table(const std::string& tab_name, const std::vector<Bar>& data, int start = 0, bool skip_existing = false) = 0;
+   // read table and record the data into a vector of Bars
+   virtual std::vector<Bar> read_table(const std::string& tab_name) = 0;
+   // read table from a given start date (included)
+   virtual std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date) = 0;
+   // read table between a given start date and a given end date (included)
+   virtual std::vector<Bar> read_table(const std::string& tab_name, const std::string& start_date, const std::string& end_date) = 0;
+   // get last n rows from table (most recent will be first element in vector)
+   virtual std::vector<Bar> read_table(const std::string& tab_name, unsigned n) = 0;
+   // get last row from table into x, return false if the table is empty or missing
+   virtual bool get_last_row(const std::string& tab_name, Bar& x) = 0;
+};
+
+//=================================================================================================
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+// End-to-end ingest benchmark: a local HTTP server serves synthetic candles in the bidask format 
+// of Oanda /v1/candles endpoint, OandaAPI is pointed at it and tables are written to the MySQL 
+// database configured in QuotesDB.hpp, which must exist.
+// NB: tables BENCH_EUR_USD_* of the database are re-initialized, a scratch database is required
+// so that no real table is ever overwritten
+//
+// usage: ./bench db_name [start_date] [port]
+
+#include "QuotesDB.hpp"
+
+#include <Poco/Net/HTTPServer.h>                // for HTTPServer
+#include <Poco/Net/HTTPServerParams.h>          // for HTTPServerParams
+#include <Poco/Net/HTTPRequestHandler.h>        // for HTTPRequestHandler
+#include <Poco/Net/HTTPRequestHandlerFactory.h> // for HTTPRequestHandlerFactory
+#include <Poco/Net/HTTPServerRequest.h>         // for HTTPServerRequest
+#include <Poco/Net/HTTPServerResponse.h>        // for HTTPServerResponse
+#include <Poco/Net/ServerSocket.h>              // for ServerSocket
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sys/resource.h>
+
+//=================================================================================================
+
+// request handler serving synthetic candles, with the same cleaning as Oanda (no candle on day offs)
+
+class CandlesHandler : public Poco::Net::HTTPRequestHandler
+{
+public:
+   void handleRequest(Poco::Net::HTTPServerRequest& req, Poco::Net::HTTPServerResponse& resp)
+   {
+      std::string instrument, granularity = "S5", start, end;
+      int count = BLOCK_SIZE;
+
+      Poco::URI uri(req.getURI());
+      for (const auto& param : uri.getQueryParameters()) {
+         if (param.first == "instrument") instrument = param.second;
+         else if (param.first == "granularity") granularity = param.second;
+         else if (param.first == "start") start = param.second;
+         else if (param.first == "end") end = param.second;
+         else if (param.first == "count") count = std::stoi(param.second);
+      }
+
+      int nb_secs = qdb::granularity_to_sec(granularity);
+      if (nb_secs == 0 || start.empty()) {
+         resp.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+         resp.send() << "{\"code\":1,\"message\":\"invalid request\"}";
+         return;
+      }
+
+      // candles aligned on granularity from start date, end date excluded
+      time_t t = qdb::parse_date(start.c_str());
+      t += (nb_secs - t % nb_secs) % nb_secs;
+      time_t end_t = end.empty() ? std::numeric_limits<time_t>::max() : qdb::parse_date(end.c_str());
+      time_t now = time(nullptr);
+
+      // compressing the response if the client accepts it, as Oanda does
+      bool gzip = req.get("Accept-Encoding", "").find("gzip") != std::string::npos;
+
+      resp.setChunkedTransferEncoding(true);
+      resp.setContentType("application/json");
+      if (gzip) resp.set("Content-Encoding", "gzip");
+      std::ostream& body = resp.send();
+      std::unique_ptr<Poco::DeflatingOutputStream> deflater;
+      if (gzip) deflater.reset(new Poco::DeflatingOutputStream(body, Poco::DeflatingStreamBuf::STREAM_GZIP));
+      std::ostream& out = gzip ? *deflater : body;
+      out << "{\n\t\"instrument\" : \"" << instrument << "\",\n\t\"granularity\" : \"" << granularity << "\",\n\t\"candles\" : [";
+
+      char buf[512];
+      bool first = true;
+      for (int n = 0; t < end_t && t < now && n < count; t += nb_secs) {
+         if (qdb::is_day_off(qdb::utc_to_est(t))) continue;
+         // deterministic prices oscillating around 1.1
+         double mid = 1.1 + 0.05 * std::sin(t / 86400.0) + 0.001 * std::sin(t / 600.0);
+         char date[20];
+         qdb::format_date(t, date);
+         date[10] = 'T';
+         std::snprintf(buf, sizeof(buf),
+                       "%s\n\t\t{\n\t\t\t\"time\" : \"%s.000000Z\",\n"
+                       "\t\t\t\"openBid\" : %.5f,\n\t\t\t\"openAsk\" : %.5f,\n"
+                       "\t\t\t\"highBid\" : %.5f,\n\t\t\t\"highAsk\" : %.5f,\n"
+                       "\t\t\t\"lowBid\" : %.5f,\n\t\t\t\"lowAsk\" : %.5f,\n"
+                       "\t\t\t\"closeBid\" : %.5f,\n\t\t\t\"closeAsk\" : %.5f,\n"
+                       "\t\t\t\"volume\" : %d,\n\t\t\t\"complete\" : %s\n\t\t}",
+                       first ? "" : ",", date,
+                       mid - 1e-4, mid + 1e-4, mid + 5e-4, mid + 7e-4, mid - 7e-4, mid - 5e-4, mid + 1e-5, mid + 2e-4,
+                       static_cast<int>(t % 997) + 1, t + nb_secs <= now ? "true" : "false");
+         out << buf;
+         first = false;
+         ++n;
+      }
+      out << "\n\t]\n}";
+      if (deflater) deflater->close();
+   }
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+class CandlesHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory
+{
+public:
+   Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest&)
+   {
+      return new CandlesHandler;
+   }
+};
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// reset peak resident set size of the process to its current size (Linux), return false if not supported
+bool reset_peak_rss()
+{
+   std::ofstream file("/proc/self/clear_refs");
+   file << "5";
+   file.close();
+   return !file.fail();
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get peak resident set size of the process in MB since the last reset
+double peak_rss()
+{
+   std::ifstream file("/proc/self/status");
+   std::string line;
+   while (std::getline(file, line)) {
+      if (line.compare(0, 6, "VmHWM:") == 0) return std::stod(line.substr(6)) / 1024.0;
+   }
+   // peak since the start of the process
+   rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   return usage.ru_maxrss / 1024.0;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get seconds elapsed since t0
+double elapsed(const std::chrono::steady_clock::time_point& t0)
+{
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//=================================================================================================
+
+int main(int argc, char* argv[])
+{
+   // NB: no default database so that the benchmark never writes to a real one by mistake
+   if (argc < 2) {
+      std::fprintf(stderr, "usage: %s db_name [start_date] [port]\n", argv[0]);
+      return 1;
+   }
+   std::string db_name = argv[1];
+   std::string start_date = argc > 2 ? argv[2] : qdb::sec_to_string(time(nullptr) - 365 * 86400);
+   unsigned short port = argc > 3 ? std::stoi(argv[3]) : 8080;
+
+   // starting local server
+   Poco::Net::ServerSocket socket(port);
+   Poco::Net::HTTPServerParams::Ptr params = new Poco::Net::HTTPServerParams;
+   params->setKeepAlive(true);
+   Poco::Net::HTTPServer server(new CandlesHandlerFactory, socket, params);
+   server.start();
+
+   const std::string url = "http://127.0.0.1:" + std::to_string(port);
+   // scratch instrument name, the server serving the same candles whatever the instrument
+   const std::string instrument = "BENCH_EUR_USD";
+   const std::vector<std::string> granularities = {"D","H1","M15","M1"};
+   const std::vector<int> block_sizes = {500,2000,5000};
+
+   std::vector<std::string> results;
+
+   for (const auto& granularity : granularities) {
+      for (int block_size : block_sizes) {
+         // peak memory being measured per configuration when supported
+         bool rss_reset = reset_peak_rss();
+         qdb::OandaAPI api(url);
+         api.setBlockSize(block_size);
+         qdb::DataBase db(db_name);
+         std::string tab_name = instrument + "_" + granularity;
+
+         // timing each stage one after the other on a scratch table
+         double t_download = 0, t_parse = 0, t_write = 0;
+         std::size_t nb_bars = 0;
+         db.create_table(tab_name);
+         std::vector<std::string> dates = qdb::getDates(start_date, qdb::get_utc_time(), granularity, block_size);
+         std::vector<qdb::Bar> data;
+         for (std::size_t i = 0; i + 1 < dates.size(); ++i) {
+            auto t0 = std::chrono::steady_clock::now();
+            std::string content = api.request("/v1/candles?instrument=" + instrument + "&start=" + dates[i] + "&end=" + dates[i+1] +
+                                              "&candleFormat=bidask&granularity=" + granularity);
+            t_download += elapsed(t0);
+            t0 = std::chrono::steady_clock::now();
+            api.parseHistoData(content, qdb::string_to_sec(qdb::oanda_to_string(dates[i])), data);
+            t_parse += elapsed(t0);
+            t0 = std::chrono::steady_clock::now();
+            db.write_table(tab_name, data);
+            t_write += elapsed(t0);
+            nb_bars += data.size();
+            data.clear();
+         }
+
+         // timing end-to-end pipelined initialization and update
+         auto t0 = std::chrono::steady_clock::now();
+         api.initTab(db, instrument, granularity, start_date);
+         double t_init = elapsed(t0);
+         t0 = std::chrono::steady_clock::now();
+         api.updateTab(db, instrument, granularity);
+         double t_update = elapsed(t0);
+
+         char rss[32] = "n/a";
+         if (rss_reset) std::snprintf(rss, sizeof(rss), "%.1f", peak_rss());
+         char buf[256];
+         std::snprintf(buf, sizeof(buf), "%-5s %6d %10zu %12.0f %10.3f %10.3f %10.3f %10.3f %10.3f %10s",
+                       granularity.c_str(), block_size, nb_bars, nb_bars / t_init, t_init,
+                       t_download, t_parse, t_write, t_update, rss);
+         results.push_back(buf);
+      }
+   }
+
+   server.stop();
+
+   std::printf("\n%-5s %6s %10s %12s %10s %10s %10s %10s %10s %10s\n", "gran", "block", "bars", "bars/sec",
+               "init(s)", "http(s)", "parse(s)", "write(s)", "update(s)", "rss(MB)");
+   for (const auto& line : results) {
+      std::printf("%s\n", line.c_str());
+   }
+}
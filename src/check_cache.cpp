@@ -0,0 +1,92 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+// Bar cache check: reads through BarCache (BarCache.hpp) are compared to reads of an in-memory table
+// written between them, in particular a read ending just before the current time followed by a Bar
+// appended within the dates it covered.
+//
+// usage: ./check_cache (exit status 1 if any result differs)
+
+#include "QuotesDB.hpp"
+
+#include <cstdio>
+
+//=================================================================================================
+
+// in-memory table of M1 Bars in date order
+std::vector<qdb::Bar> table;
+// number of reads made by the cache
+std::size_t nb_fetches = 0;
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// read Bars of the table with dates in [start_t,end_t]
+std::vector<qdb::Bar> fetch(unsigned start_t, unsigned end_t)
+{
+   ++nb_fetches;
+   std::vector<qdb::Bar> data;
+   for (const auto& x : table) {
+      if (x.date >= start_t && x.date <= end_t) data.push_back(x);
+   }
+   return data;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// append a Bar at date to the table
+void append(unsigned date)
+{
+   table.emplace_back(date, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// compare a read of [start_t,end_t] through the cache to a read of the table, return 1 if they differ
+std::size_t check(qdb::BarCache& cache, unsigned start_t, unsigned end_t, const char* name)
+{
+   std::vector<qdb::Bar> data = cache.get("EUR_USD_M1", start_t, end_t, fetch);
+   std::vector<qdb::Bar> expected = fetch(start_t, end_t);
+
+   bool same = (data.size() == expected.size());
+   for (std::size_t i = 0; same && i < data.size(); ++i) {
+      same = (data[i].date == expected[i].date);
+   }
+   if (!same) {
+      std::printf("%s: %zu Bar(s) instead of %zu\n", name, data.size(), expected.size());
+      return 1;
+   }
+   return 0;
+}
+
+//=================================================================================================
+
+int main()
+{
+   qdb::BarCache cache(1 << 20);
+
+   std::size_t nb_errors = 0;
+
+   // last minute started before the current time, its Bar being written once the minute is over
+   unsigned now = static_cast<unsigned>(time(nullptr));
+   unsigned minute = now - now % 60;
+   for (unsigned t = minute - 600; t < minute; t += 60) append(t);
+
+   // read ending just before the current time, before the Bar of the last minute is written
+   nb_errors += check(cache, minute - 600, now - 1, "read before append");
+   append(minute);
+   nb_errors += check(cache, minute - 600, now - 1, "read after append");
+
+   // historical read then appended Bars read again from the cache
+   nb_errors += check(cache, minute - 600, minute - 301, "historical read");
+   std::size_t nb = nb_fetches;
+   nb_errors += check(cache, minute - 540, minute - 360, "cached read");
+   if (nb_fetches != nb + 1) {
+      std::printf("cached read: %zu read(s) of the table instead of none\n", nb_fetches - nb - 1);
+      ++nb_errors;
+   }
+
+   std::printf("%zu difference(s)\n", nb_errors);
+
+   return nb_errors == 0 ? 0 : 1;
+}
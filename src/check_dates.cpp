@@ -0,0 +1,118 @@
+//=================================================================================================
+//                    Copyright (C) 2017 Olivier Mallet - All Rights Reserved                      
+//=================================================================================================
+
+// Date conversion check: utc_to_est, est_to_utc and is_day_off (DateTime.hpp) are compared to the
+// libc based conversions they replaced (TZ set to EST5EDT4, localtime and mktime) on about 2M dates
+// between 1970 and 2038, and on every minute of the 6 hours around each DST transition.
+//
+// usage: ./check_dates (exit status 1 if any result differs)
+
+#include "QuotesDB.hpp"
+
+#include <cstdio>
+
+//=================================================================================================
+
+// get US/Eastern local time from UTC time in seconds since epoch through libc
+time_t libc_utc_to_est(time_t t)
+{
+   tm* p = localtime(&t);
+   return qdb::civil_to_sec(p->tm_year + 1900, p->tm_mon + 1, p->tm_mday, p->tm_hour, p->tm_min, p->tm_sec);
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// get UTC time from US/Eastern local time in seconds since epoch through libc, a local time repeated
+// when DST ends being taken as standard time (second occurrence)
+// NB: mktime picks either occurrence depending on the glibc version and on its previous calls
+time_t libc_est_to_utc(time_t local)
+{
+   tm d = {};
+   gmtime_r(&local, &d);
+   d.tm_isdst = -1;
+   time_t t = mktime(&d);
+
+   if (libc_utc_to_est(t + 3600) == local) t += 3600;
+   return t;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// check wether a US/Eastern date in seconds since epoch is on a week-end, x-mas or new-year through libc
+bool libc_is_day_off(time_t t)
+{
+   tm d = {};
+   gmtime_r(&t, &d);
+
+   if ((d.tm_wday == 5 && d.tm_hour >= 17) || d.tm_wday == 6 || (d.tm_wday == 0 && d.tm_hour < 17)) return true;
+   if ((d.tm_mon == 11 && d.tm_mday == 24 && d.tm_hour >= 17) || (d.tm_mon == 11 && d.tm_mday == 25 && d.tm_hour < 17)) return true;
+   if ((d.tm_mon == 11 && d.tm_mday == 31 && d.tm_hour >= 17) || (d.tm_mon == 0 && d.tm_mday == 1 && d.tm_hour < 17)) return true;
+   return false;
+}
+
+/*-------------------------------------------------------------------------------------------------*/
+
+// compare conversions of date t, printing the first differences, return number of differences
+std::size_t check(time_t t)
+{
+   static std::size_t nb_printed = 0;
+   std::size_t nb_errors = 0;
+   char a[20], b[20], c[20];
+
+   if (qdb::utc_to_est(t) != libc_utc_to_est(t)) {
+      ++nb_errors;
+      if (nb_printed++ < 10) {
+         qdb::format_date(t, a); qdb::format_date(qdb::utc_to_est(t), b); qdb::format_date(libc_utc_to_est(t), c);
+         std::printf("utc_to_est(%s): %s instead of %s\n", a, b, c);
+      }
+   }
+   if (qdb::est_to_utc(t) != libc_est_to_utc(t)) {
+      ++nb_errors;
+      if (nb_printed++ < 10) {
+         qdb::format_date(t, a); qdb::format_date(qdb::est_to_utc(t), b); qdb::format_date(libc_est_to_utc(t), c);
+         std::printf("est_to_utc(%s): %s instead of %s\n", a, b, c);
+      }
+   }
+   if (qdb::is_day_off(t) != libc_is_day_off(t)) {
+      ++nb_errors;
+      if (nb_printed++ < 10) {
+         qdb::format_date(t, a);
+         std::printf("is_day_off(%s): %d instead of %d\n", a, !libc_is_day_off(t), libc_is_day_off(t));
+      }
+   }
+
+   return nb_errors;
+}
+
+//=================================================================================================
+
+int main()
+{
+   setenv("TZ", "EST5EDT4", 1);
+   tzset();
+
+   std::size_t nb_dates = 0, nb_errors = 0;
+
+   // dates spread over the whole range, the step being coprime with an hour so that every
+   // second of the hour is eventually reached
+   const time_t last = 2145916800;
+   for (time_t t = 0; t < last; t += 1069) {
+      nb_errors += check(t);
+      ++nb_dates;
+   }
+
+   // every minute around DST transitions, both as UTC and as local dates
+   for (time_t t = 0; t < last; t += 3600) {
+      if (libc_utc_to_est(t) - t == libc_utc_to_est(t + 3600) - (t + 3600)) continue;
+      for (time_t u = t - 3 * 3600; u < t + 3 * 3600; u += 60) {
+         nb_errors += check(u);
+         nb_errors += check(libc_utc_to_est(u));
+         nb_dates += 2;
+      }
+   }
+
+   std::printf("%zu dates checked, %zu difference(s)\n", nb_dates, nb_errors);
+
+   return nb_errors == 0 ? 0 : 1;
+}
@@ -15,6 +15,16 @@ int main()
    
    // you can the update later the database by simply doing:
    //conn.updateAllTabs("QuotesDB");
+   // or concurrently with 8 workers:
+   //conn.updateAllTabs("QuotesDB", 8);
+   // or keep all the tables up to date, each new Bar being appended as soon as it closes:
+   //qdb::Scheduler scheduler(conn,"QuotesDB");
+   //scheduler.addAll();
+   //scheduler.run();
+   // tables can be checked for holes left by failed downloads, only the missing Bars being downloaded
+   // again, here scanning all tables with 4 workers:
+   //qdb::GapScanner scanner(conn,"QuotesDB");
+   //scanner.scanAll(true, 4);
 
    // connecting to QuotesDB database for reading data
    qdb::DataBase db("QuotesDB");